@@ -0,0 +1,307 @@
+/**
+ * @file bench/bench.cpp
+ * @brief Measurement and reports shared by r2plugin benchmarks.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#include "bench.h"
+
+using namespace retdec::r2plugin::bench;
+
+namespace {
+
+std::atomic<uint64_t> allocationCount(0);
+std::atomic<uint64_t> allocationBytes(0);
+
+}
+
+// Every allocation of the process, including those made by the plugin
+// library, goes through these.
+void* operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+namespace retdec {
+namespace r2plugin {
+namespace bench {
+
+Allocations Allocations::now()
+{
+	return {allocationCount.load(), allocationBytes.load()};
+}
+
+Measurement measure(const std::function<void()>& operation, double minSeconds)
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Warm up caches and lazily initialized statics.
+	operation();
+
+	uint64_t batch = 1;
+	while (true) {
+		auto allocations = Allocations::now();
+		auto start = Clock::now();
+		for (uint64_t i = 0; i < batch; i++)
+			operation();
+
+		std::chrono::duration<double> elapsed = Clock::now() - start;
+		auto after = Allocations::now();
+
+		if (elapsed.count() >= minSeconds || batch >= (uint64_t(1) << 40)) {
+			Measurement result;
+			result.iterations = batch;
+			result.nsPerOp = elapsed.count() * 1e9 / batch;
+			result.opsPerSecond = batch / elapsed.count();
+			result.allocationsPerOp = double(after.count - allocations.count) / batch;
+			result.allocatedBytesPerOp = double(after.bytes - allocations.bytes) / batch;
+			return result;
+		}
+
+		// Aim slightly above the minimal time with the next batch.
+		auto scale = elapsed.count() > 0 ? 1.2 * minSeconds / elapsed.count() : 10;
+		batch = std::max(batch + 1, uint64_t(batch * std::min(scale, 10.0)));
+	}
+}
+
+double percentile(std::vector<double> samples, double p)
+{
+	if (samples.empty())
+		return 0;
+
+	std::sort(samples.begin(), samples.end());
+	auto rank = size_t(std::ceil(p * samples.size()));
+	return samples[std::max<size_t>(rank, 1) - 1];
+}
+
+Report::Report(const std::string& benchmark):
+	_benchmark(benchmark)
+{
+	if (!benchmark.empty()) {
+		_info["plugin_version"] = R2RETDEC_VERSION;
+		_info["retdec_revision"] = R2RETDEC_RETDEC_REVISION;
+	}
+}
+
+void Report::add(const std::string& name, double value, const std::string& unit, Better better)
+{
+	_metrics[name] = {value, unit, better};
+}
+
+void Report::setInfo(const std::string& key, const std::string& value)
+{
+	_info[key] = value;
+}
+
+const std::string& Report::benchmark() const
+{
+	return _benchmark;
+}
+
+const std::map<std::string, Report::Metric>& Report::metrics() const
+{
+	return _metrics;
+}
+
+const std::map<std::string, std::string>& Report::info() const
+{
+	return _info;
+}
+
+void Report::print() const
+{
+	size_t width = 0;
+	for (auto& [name, metric]: _metrics)
+		width = std::max(width, name.size());
+
+	for (auto& [name, metric]: _metrics) {
+		std::cout << "    " << std::left << std::setw(width) << name << std::right
+			<< std::setw(16) << std::fixed << std::setprecision(2) << metric.value
+			<< " " << metric.unit << std::endl;
+	}
+}
+
+/**
+ * @brief Saves report as JSON:
+ *
+ * {"benchmark": name, "info": {key: value},
+ *  "metrics": {name: {"value": number, "unit": unit, "better": "lower"|"higher"}}}
+ */
+void Report::save(const std::string& path) const
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("benchmark");
+	writer.String(_benchmark.c_str());
+
+	writer.Key("info");
+	writer.StartObject();
+	for (auto& [key, value]: _info) {
+		writer.Key(key.c_str());
+		writer.String(value.c_str());
+	}
+	writer.EndObject();
+
+	writer.Key("metrics");
+	writer.StartObject();
+	for (auto& [name, metric]: _metrics) {
+		writer.Key(name.c_str());
+		writer.StartObject();
+		writer.Key("value");
+		writer.Double(metric.value);
+		writer.Key("unit");
+		writer.String(metric.unit.c_str());
+		writer.Key("better");
+		writer.String(metric.better == Better::Lower ? "lower" : "higher");
+		writer.EndObject();
+	}
+	writer.EndObject();
+	writer.EndObject();
+
+	std::ofstream output(path, std::ios::trunc);
+	if (!output)
+		throw std::runtime_error("unable to write report: "+path);
+
+	output << buffer.GetString() << std::endl;
+}
+
+Report Report::load(const std::string& path)
+{
+	std::ifstream input(path);
+	if (!input)
+		throw std::runtime_error("unable to read report: "+path);
+
+	std::stringstream content;
+	content << input.rdbuf();
+
+	rapidjson::Document root;
+	root.Parse(content.str().c_str());
+	if (root.HasParseError() || !root.IsObject() || !root.HasMember("metrics")
+			|| !root["metrics"].IsObject())
+		throw std::runtime_error("malformed report: "+path);
+
+	// Info of the loaded report is not mixed with the current build.
+	Report report;
+	if (root.HasMember("benchmark") && root["benchmark"].IsString())
+		report._benchmark = root["benchmark"].GetString();
+
+	if (root.HasMember("info") && root["info"].IsObject()) {
+		auto& info = root["info"];
+		for (auto item = info.MemberBegin(); item != info.MemberEnd(); ++item) {
+			if (item->value.IsString())
+				report.setInfo(item->name.GetString(), item->value.GetString());
+		}
+	}
+
+	auto& metrics = root["metrics"];
+	for (auto item = metrics.MemberBegin(); item != metrics.MemberEnd(); ++item) {
+		std::string name = item->name.GetString();
+		auto& metric = item->value;
+		if (!metric.IsObject() || !metric.HasMember("value") || !metric["value"].IsNumber())
+			throw std::runtime_error("malformed metric "+name+": "+path);
+
+		std::string unit = metric.HasMember("unit") && metric["unit"].IsString()
+			? metric["unit"].GetString() : "";
+		bool higher = metric.HasMember("better") && metric["better"].IsString()
+			&& std::string(metric["better"].GetString()) == "higher";
+
+		report.add(name, metric["value"].GetDouble(), unit,
+			higher ? Better::Higher : Better::Lower);
+	}
+
+	return report;
+}
+
+Arguments::Arguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.rfind("--", 0) != 0) {
+			_positional.push_back(arg);
+			continue;
+		}
+
+		auto eq = arg.find('=');
+		if (eq != std::string::npos)
+			_options[arg.substr(0, eq)] = arg.substr(eq+1);
+		else if (i+1 < argc && std::string(argv[i+1]).rfind("--", 0) != 0)
+			_options[arg] = argv[++i];
+		else
+			_options[arg] = "";
+	}
+}
+
+bool Arguments::has(const std::string& option) const
+{
+	return _options.count(option) != 0;
+}
+
+std::string Arguments::get(const std::string& option, const std::string& def) const
+{
+	auto it = _options.find(option);
+	return it != _options.end() ? it->second : def;
+}
+
+double Arguments::number(const std::string& option, double def) const
+{
+	auto it = _options.find(option);
+	return it != _options.end() && !it->second.empty() ? std::stod(it->second) : def;
+}
+
+const std::vector<std::string>& Arguments::positional() const
+{
+	return _positional;
+}
+
+}
+}
+}
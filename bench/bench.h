@@ -0,0 +1,113 @@
+/**
+ * @file bench/bench.h
+ * @brief Measurement and reports shared by r2plugin benchmarks.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_BENCH_BENCH_H
+#define RETDEC_R2PLUGIN_BENCH_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace retdec {
+namespace r2plugin {
+namespace bench {
+
+/**
+ * Allocations made through global operator new since the start
+ * of the process. Counted only in benchmark executables.
+ */
+struct Allocations {
+	uint64_t count;
+	uint64_t bytes;
+
+	static Allocations now();
+};
+
+/**
+ * Result of a benchmarked operation.
+ */
+struct Measurement {
+	uint64_t iterations;
+	double nsPerOp;
+	double opsPerSecond;
+	double allocationsPerOp;
+	double allocatedBytesPerOp;
+};
+
+/**
+ * Runs the operation in growing batches until the batch takes at least
+ * minSeconds and returns measurement of the last batch.
+ */
+Measurement measure(const std::function<void()>& operation, double minSeconds);
+
+/**
+ * Returns value at nearest rank of the percentile (0 to 1).
+ */
+double percentile(std::vector<double> samples, double p);
+
+/**
+ * Flat set of named metrics produced by a benchmark run and stored
+ * as JSON so that runs can be compared.
+ */
+class Report {
+public:
+	/// Which direction of change of a metric is an improvement.
+	enum class Better {
+		Lower,
+		Higher
+	};
+
+	struct Metric {
+		double value;
+		std::string unit;
+		Better better;
+	};
+
+public:
+	/// Report of a named benchmark records versions of the plugin and RetDec.
+	Report(const std::string& benchmark = "");
+
+	void add(const std::string& name, double value, const std::string& unit, Better better);
+	void setInfo(const std::string& key, const std::string& value);
+
+	const std::string& benchmark() const;
+	const std::map<std::string, Metric>& metrics() const;
+	const std::map<std::string, std::string>& info() const;
+
+	void print() const;
+	void save(const std::string& path) const;
+	static Report load(const std::string& path);
+
+private:
+	std::string _benchmark;
+	std::map<std::string, Metric> _metrics;
+	std::map<std::string, std::string> _info;
+};
+
+/**
+ * Minimal parser of --option value pairs of benchmark executables.
+ */
+class Arguments {
+public:
+	Arguments(int argc, char** argv);
+
+	bool has(const std::string& option) const;
+	std::string get(const std::string& option, const std::string& def = "") const;
+	double number(const std::string& option, double def) const;
+	const std::vector<std::string>& positional() const;
+
+private:
+	std::map<std::string, std::string> _options;
+	std::vector<std::string> _positional;
+};
+
+}
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_BENCH_BENCH_H*/
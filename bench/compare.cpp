@@ -0,0 +1,228 @@
+/**
+ * @file bench/compare.cpp
+ * @brief Comparison of benchmark reports with tolerances per metric.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ *
+ * Usage: r2retdec-bench-compare <baseline.json> <current.json>
+ *                               [--tolerances file] [--skip-missing-baseline]
+ *
+ * Exits with 1 when a metric covered by the tolerances regressed beyond
+ * its tolerance or is missing in the current report, 2 on invalid input.
+ * With --skip-missing-baseline a missing baseline report is not an error,
+ * the comparison exits with 77 (skipped test for ctest).
+ *
+ * Tolerance file has a rule per line: metric pattern and allowed
+ * regression in percent of the baseline value, or "ignore". Pattern may
+ * contain '*' matching any text. The first matching rule applies,
+ * metrics without a rule are only printed. Lines starting with '#'
+ * are comments.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+#include "bench.h"
+
+using namespace retdec::r2plugin::bench;
+
+namespace {
+
+/// Exit code of a skipped comparison (SKIP_RETURN_CODE of the test).
+const int SkippedExitCode = 77;
+
+struct Rule {
+	std::string pattern;
+	/// Allowed regression in percent, none for ignored metrics.
+	std::optional<double> tolerance;
+};
+
+bool matches(const std::string& pattern, const std::string& text)
+{
+	size_t p = 0, t = 0;
+	size_t star = std::string::npos, resume = 0;
+
+	while (t < text.size()) {
+		if (p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			resume = t;
+		}
+		else if (p < pattern.size() && pattern[p] == text[t]) {
+			p++;
+			t++;
+		}
+		else if (star != std::string::npos) {
+			p = star + 1;
+			t = ++resume;
+		}
+		else {
+			return false;
+		}
+	}
+
+	while (p < pattern.size() && pattern[p] == '*')
+		p++;
+
+	return p == pattern.size();
+}
+
+std::vector<Rule> loadRules(const std::string& path)
+{
+	std::ifstream input(path);
+	if (!input)
+		throw std::runtime_error("unable to read tolerances: "+path);
+
+	std::vector<Rule> rules;
+	std::string line;
+	while (std::getline(input, line)) {
+		std::istringstream fields(line);
+		std::string pattern, tolerance;
+		if (!(fields >> pattern) || pattern[0] == '#')
+			continue;
+
+		if (!(fields >> tolerance))
+			throw std::runtime_error("missing tolerance of "+pattern+": "+path);
+
+		if (tolerance == "ignore")
+			rules.push_back({pattern, std::nullopt});
+		else
+			rules.push_back({pattern, std::stod(tolerance)});
+	}
+
+	return rules;
+}
+
+const Rule* findRule(const std::vector<Rule>& rules, const std::string& metric)
+{
+	for (auto& rule: rules) {
+		if (matches(rule.pattern, metric))
+			return &rule;
+	}
+
+	return nullptr;
+}
+
+/**
+ * Returns regression of the metric in percent of the baseline.
+ * Negative values are improvements.
+ */
+double regression(const Report::Metric& baseline, double current)
+{
+	auto delta = baseline.better == Report::Better::Lower
+		? current - baseline.value
+		: baseline.value - current;
+
+	if (baseline.value == 0) {
+		if (delta == 0)
+			return 0;
+
+		return delta > 0
+			? std::numeric_limits<double>::infinity()
+			: -std::numeric_limits<double>::infinity();
+	}
+
+	return delta / std::fabs(baseline.value) * 100;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Arguments args(argc, argv);
+	if (args.positional().size() != 2) {
+		std::cerr << "usage: " << argv[0]
+			<< " <baseline.json> <current.json> [--tolerances file] [--skip-missing-baseline]"
+			<< std::endl;
+		return 2;
+	}
+
+	if (args.has("--skip-missing-baseline") && !std::ifstream(args.positional()[0])) {
+		std::cout << "no baseline " << args.positional()[0] << ", skipping" << std::endl;
+		return SkippedExitCode;
+	}
+
+	try {
+		auto baseline = Report::load(args.positional()[0]);
+		auto current = Report::load(args.positional()[1]);
+		auto rules = args.has("--tolerances")
+			? loadRules(args.get("--tolerances"))
+			: std::vector<Rule>{};
+
+		if (baseline.benchmark() != current.benchmark()) {
+			std::cerr << "reports of different benchmarks: " << baseline.benchmark()
+				<< " and " << current.benchmark() << std::endl;
+			return 2;
+		}
+
+		for (auto& [key, value]: baseline.info()) {
+			auto it = current.info().find(key);
+			if (it != current.info().end() && it->second != value)
+				std::cout << key << ": " << value << " -> " << it->second << std::endl;
+		}
+
+		size_t width = 6;
+		for (auto& [name, metric]: baseline.metrics())
+			width = std::max(width, name.size());
+
+		std::cout << std::left << std::setw(width) << "metric" << std::right
+			<< std::setw(14) << "baseline" << std::setw(14) << "current"
+			<< std::setw(10) << "change" << std::setw(10) << "limit" << "  status" << std::endl;
+
+		size_t regressions = 0;
+		for (auto& [name, metric]: baseline.metrics()) {
+			auto rule = findRule(rules, name);
+			bool gated = rule != nullptr && rule->tolerance.has_value();
+
+			std::cout << std::left << std::setw(width) << name << std::right << std::fixed
+				<< std::setprecision(2) << std::setw(14) << metric.value;
+
+			auto it = current.metrics().find(name);
+			if (it == current.metrics().end()) {
+				std::cout << std::setw(14) << "-" << std::setw(10) << "-" << std::setw(10) << "-"
+					<< (gated ? "  MISSING" : "  missing") << std::endl;
+				regressions += gated;
+				continue;
+			}
+
+			auto change = regression(metric, it->second.value);
+			std::ostringstream limit;
+			if (gated)
+				limit << std::fixed << std::setprecision(1) << *rule->tolerance << "%";
+			else
+				limit << "-";
+
+			bool regressed = gated && change > *rule->tolerance;
+			regressions += regressed;
+
+			// Sign of the change is the same for all metrics: positive is worse.
+			std::ostringstream shown;
+			shown << std::showpos << std::fixed << std::setprecision(1) << change << "%";
+
+			std::cout << std::setw(14) << it->second.value << std::setw(10) << shown.str()
+				<< std::setw(10) << limit.str()
+				<< (regressed ? "  REGRESSED" : gated ? "  ok" : "") << std::endl;
+		}
+
+		for (auto& [name, metric]: current.metrics()) {
+			if (baseline.metrics().count(name) == 0)
+				std::cout << std::left << std::setw(width) << name << std::right
+					<< std::setw(14) << "-" << std::setw(14) << metric.value << "  new" << std::endl;
+		}
+
+		if (regressions != 0) {
+			std::cout << regressions << " metric(s) regressed or missing" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& err) {
+		std::cerr << "comparison failed: " << err.what() << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
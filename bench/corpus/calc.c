@@ -0,0 +1,129 @@
+/* Recursive descent parser and evaluator of arithmetic expressions. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+enum token_kind { T_NUMBER, T_PLUS, T_MINUS, T_MUL, T_DIV, T_LPAREN, T_RPAREN, T_END, T_ERROR };
+
+struct lexer {
+	const char *input;
+	size_t pos;
+	enum token_kind kind;
+	double value;
+};
+
+static void next_token(struct lexer *lex)
+{
+	while (isspace((unsigned char)lex->input[lex->pos]))
+		lex->pos++;
+
+	char c = lex->input[lex->pos];
+	if (c == '\0') {
+		lex->kind = T_END;
+		return;
+	}
+
+	if (isdigit((unsigned char)c) || c == '.') {
+		char *end;
+		lex->value = strtod(lex->input + lex->pos, &end);
+		lex->pos = (size_t)(end - lex->input);
+		lex->kind = T_NUMBER;
+		return;
+	}
+
+	lex->pos++;
+	switch (c) {
+	case '+': lex->kind = T_PLUS; break;
+	case '-': lex->kind = T_MINUS; break;
+	case '*': lex->kind = T_MUL; break;
+	case '/': lex->kind = T_DIV; break;
+	case '(': lex->kind = T_LPAREN; break;
+	case ')': lex->kind = T_RPAREN; break;
+	default: lex->kind = T_ERROR; break;
+	}
+}
+
+static double parse_expression(struct lexer *lex, int *error);
+
+static double parse_primary(struct lexer *lex, int *error)
+{
+	if (lex->kind == T_NUMBER) {
+		double value = lex->value;
+		next_token(lex);
+		return value;
+	}
+	if (lex->kind == T_MINUS) {
+		next_token(lex);
+		return -parse_primary(lex, error);
+	}
+	if (lex->kind == T_LPAREN) {
+		next_token(lex);
+		double value = parse_expression(lex, error);
+		if (lex->kind != T_RPAREN)
+			*error = 1;
+		next_token(lex);
+		return value;
+	}
+
+	*error = 1;
+	return 0;
+}
+
+static double parse_term(struct lexer *lex, int *error)
+{
+	double value = parse_primary(lex, error);
+	while (lex->kind == T_MUL || lex->kind == T_DIV) {
+		enum token_kind op = lex->kind;
+		next_token(lex);
+		double rhs = parse_primary(lex, error);
+		if (op == T_MUL)
+			value *= rhs;
+		else if (rhs != 0)
+			value /= rhs;
+		else
+			*error = 2;
+	}
+	return value;
+}
+
+static double parse_expression(struct lexer *lex, int *error)
+{
+	double value = parse_term(lex, error);
+	while (lex->kind == T_PLUS || lex->kind == T_MINUS) {
+		enum token_kind op = lex->kind;
+		next_token(lex);
+		double rhs = parse_term(lex, error);
+		value = op == T_PLUS ? value + rhs : value - rhs;
+	}
+	return value;
+}
+
+static int evaluate(const char *input, double *result)
+{
+	struct lexer lex = {input, 0, T_END, 0};
+	int error = 0;
+
+	next_token(&lex);
+	*result = parse_expression(&lex, &error);
+	if (lex.kind != T_END)
+		error = 1;
+	return error;
+}
+
+int main(void)
+{
+	char line[512];
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\n")] = '\0';
+
+		double result;
+		switch (evaluate(line, &result)) {
+		case 0: printf("%g\n", result); break;
+		case 2: printf("division by zero\n"); break;
+		default: printf("syntax error\n"); break;
+		}
+	}
+	return 0;
+}
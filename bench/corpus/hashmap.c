@@ -0,0 +1,135 @@
+/* Open addressing hash map counting words of the input. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+struct entry {
+	char *key;
+	unsigned count;
+};
+
+struct map {
+	struct entry *entries;
+	size_t capacity;
+	size_t size;
+};
+
+static unsigned long hash_string(const char *str)
+{
+	unsigned long hash = 5381;
+	int c;
+	while ((c = (unsigned char)*str++))
+		hash = ((hash << 5) + hash) + c;
+	return hash;
+}
+
+static char *copy_string(const char *str)
+{
+	size_t size = strlen(str) + 1;
+	char *copy = malloc(size);
+	if (copy)
+		memcpy(copy, str, size);
+	return copy;
+}
+
+static int map_init(struct map *map, size_t capacity)
+{
+	map->entries = calloc(capacity, sizeof(struct entry));
+	map->capacity = capacity;
+	map->size = 0;
+	return map->entries != NULL;
+}
+
+static struct entry *map_find(struct map *map, const char *key)
+{
+	size_t index = hash_string(key) & (map->capacity - 1);
+	while (map->entries[index].key && strcmp(map->entries[index].key, key) != 0)
+		index = (index + 1) & (map->capacity - 1);
+	return &map->entries[index];
+}
+
+static int map_grow(struct map *map)
+{
+	struct map bigger;
+	if (!map_init(&bigger, map->capacity * 2))
+		return 0;
+
+	for (size_t i = 0; i < map->capacity; i++) {
+		if (map->entries[i].key) {
+			*map_find(&bigger, map->entries[i].key) = map->entries[i];
+			bigger.size++;
+		}
+	}
+
+	free(map->entries);
+	*map = bigger;
+	return 1;
+}
+
+static int map_add(struct map *map, const char *key)
+{
+	if ((map->size + 1) * 4 > map->capacity * 3 && !map_grow(map))
+		return 0;
+
+	struct entry *entry = map_find(map, key);
+	if (!entry->key) {
+		entry->key = copy_string(key);
+		if (!entry->key)
+			return 0;
+		map->size++;
+	}
+	entry->count++;
+	return 1;
+}
+
+static void map_free(struct map *map)
+{
+	for (size_t i = 0; i < map->capacity; i++)
+		free(map->entries[i].key);
+	free(map->entries);
+}
+
+static const struct entry *most_frequent(const struct map *map)
+{
+	const struct entry *best = NULL;
+	for (size_t i = 0; i < map->capacity; i++) {
+		const struct entry *e = &map->entries[i];
+		if (e->key && (!best || e->count > best->count))
+			best = e;
+	}
+	return best;
+}
+
+int main(void)
+{
+	struct map map;
+	char word[128];
+	size_t length = 0;
+	int c;
+
+	if (!map_init(&map, 64))
+		return 1;
+
+	while ((c = getchar()) != EOF) {
+		if (isalnum(c) && length + 1 < sizeof(word)) {
+			word[length++] = (char)tolower(c);
+		}
+		else if (length > 0) {
+			word[length] = '\0';
+			if (!map_add(&map, word))
+				return 1;
+			length = 0;
+		}
+	}
+
+	const struct entry *best = most_frequent(&map);
+	printf("%zu words", map.size);
+	if (best)
+		printf(", most frequent: %s (%u)", best->key, best->count);
+	printf("\n");
+
+	map_free(&map);
+	return 0;
+}
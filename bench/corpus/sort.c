@@ -0,0 +1,113 @@
+/* Sorting algorithms over generated data. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned seed = 12345;
+
+static unsigned next_random(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 16) & 0x7fff;
+}
+
+static void insertion_sort(int *data, size_t size)
+{
+	for (size_t i = 1; i < size; i++) {
+		int value = data[i];
+		size_t j = i;
+		while (j > 0 && data[j-1] > value) {
+			data[j] = data[j-1];
+			j--;
+		}
+		data[j] = value;
+	}
+}
+
+static void merge(int *data, int *tmp, size_t left, size_t middle, size_t right)
+{
+	size_t i = left, j = middle, k = left;
+	while (i < middle && j < right)
+		tmp[k++] = data[i] <= data[j] ? data[i++] : data[j++];
+	while (i < middle)
+		tmp[k++] = data[i++];
+	while (j < right)
+		tmp[k++] = data[j++];
+	memcpy(data + left, tmp + left, (right - left) * sizeof(int));
+}
+
+static void merge_sort(int *data, int *tmp, size_t left, size_t right)
+{
+	if (right - left < 16) {
+		insertion_sort(data + left, right - left);
+		return;
+	}
+
+	size_t middle = left + (right - left) / 2;
+	merge_sort(data, tmp, left, middle);
+	merge_sort(data, tmp, middle, right);
+	merge(data, tmp, left, middle, right);
+}
+
+static size_t partition(int *data, size_t low, size_t high)
+{
+	int pivot = data[(low + high) / 2];
+	size_t i = low, j = high;
+	while (1) {
+		while (data[i] < pivot)
+			i++;
+		while (data[j] > pivot)
+			j--;
+		if (i >= j)
+			return j;
+		int t = data[i];
+		data[i++] = data[j];
+		data[j--] = t;
+	}
+}
+
+static void quick_sort(int *data, size_t low, size_t high)
+{
+	if (low < high) {
+		size_t p = partition(data, low, high);
+		quick_sort(data, low, p);
+		quick_sort(data, p + 1, high);
+	}
+}
+
+static int is_sorted(const int *data, size_t size)
+{
+	for (size_t i = 1; i < size; i++) {
+		if (data[i-1] > data[i])
+			return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = argc > 1 ? (size_t)atoi(argv[1]) : 10000;
+	int *data = malloc(size * sizeof(int));
+	int *copy = malloc(size * sizeof(int));
+	int *tmp = malloc(size * sizeof(int));
+	if (!data || !copy || !tmp)
+		return 1;
+
+	for (size_t i = 0; i < size; i++)
+		data[i] = (int)next_random();
+
+	memcpy(copy, data, size * sizeof(int));
+	merge_sort(copy, tmp, 0, size);
+	printf("merge sort: %s\n", is_sorted(copy, size) ? "ok" : "failed");
+
+	memcpy(copy, data, size * sizeof(int));
+	if (size > 0)
+		quick_sort(copy, 0, size - 1);
+	printf("quick sort: %s\n", is_sorted(copy, size) ? "ok" : "failed");
+
+	free(tmp);
+	free(copy);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,115 @@
+/* Interpreter of a small stack machine bytecode. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+enum opcode { OP_PUSH, OP_ADD, OP_SUB, OP_MUL, OP_DUP, OP_SWAP, OP_JNZ, OP_DEC, OP_PRINT, OP_HALT };
+
+struct vm {
+	int64_t stack[256];
+	size_t sp;
+	size_t pc;
+	unsigned long steps;
+};
+
+static int push(struct vm *vm, int64_t value)
+{
+	if (vm->sp >= sizeof(vm->stack) / sizeof(vm->stack[0]))
+		return 0;
+	vm->stack[vm->sp++] = value;
+	return 1;
+}
+
+static int pop(struct vm *vm, int64_t *value)
+{
+	if (vm->sp == 0)
+		return 0;
+	*value = vm->stack[--vm->sp];
+	return 1;
+}
+
+static int binary(struct vm *vm, enum opcode op)
+{
+	int64_t a, b;
+	if (!pop(vm, &b) || !pop(vm, &a))
+		return 0;
+
+	switch (op) {
+	case OP_ADD: return push(vm, a + b);
+	case OP_SUB: return push(vm, a - b);
+	case OP_MUL: return push(vm, a * b);
+	default: return 0;
+	}
+}
+
+static int run(struct vm *vm, const int64_t *code, size_t size)
+{
+	int64_t a, b;
+
+	while (vm->pc < size) {
+		vm->steps++;
+		switch ((enum opcode)code[vm->pc++]) {
+		case OP_PUSH:
+			if (vm->pc >= size || !push(vm, code[vm->pc++]))
+				return 0;
+			break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+			if (!binary(vm, (enum opcode)code[vm->pc-1]))
+				return 0;
+			break;
+		case OP_DUP:
+			if (!pop(vm, &a) || !push(vm, a) || !push(vm, a))
+				return 0;
+			break;
+		case OP_SWAP:
+			if (!pop(vm, &a) || !pop(vm, &b) || !push(vm, a) || !push(vm, b))
+				return 0;
+			break;
+		case OP_DEC:
+			if (!pop(vm, &a) || !push(vm, a - 1))
+				return 0;
+			break;
+		case OP_JNZ:
+			if (vm->pc >= size || !pop(vm, &a))
+				return 0;
+			if (a != 0 && !push(vm, a))
+				return 0;
+			vm->pc = a != 0 ? (size_t)code[vm->pc] : vm->pc + 1;
+			break;
+		case OP_PRINT:
+			if (!pop(vm, &a))
+				return 0;
+			printf("%lld\n", (long long)a);
+			break;
+		case OP_HALT:
+			return 1;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(void)
+{
+	/* Computes 2^20 by doubling in a loop counted down on the stack. */
+	static const int64_t program[] = {
+		OP_PUSH, 1, OP_PUSH, 20,
+		/* 4: */ OP_SWAP, OP_DUP, OP_ADD, OP_SWAP, OP_DEC, OP_JNZ, 4,
+		OP_PRINT, OP_HALT
+	};
+
+	struct vm vm;
+	memset(&vm, 0, sizeof(vm));
+
+	if (!run(&vm, program, sizeof(program) / sizeof(program[0]))) {
+		fprintf(stderr, "fault at %zu\n", vm.pc);
+		return 1;
+	}
+
+	printf("%lu steps\n", vm.steps);
+	return 0;
+}
@@ -0,0 +1,289 @@
+/**
+ * @file bench/e2e.cpp
+ * @brief End-to-end latency of decompilation over a locally built corpus.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ *
+ * Usage: r2retdec-bench-e2e [--max-functions n] [--save-dir dir]
+ *                           [--skip-whole] [--output report.json] [binary ...]
+ *
+ * Without binaries the corpus built with the benchmark (bench/corpus
+ * compiled at several optimization levels) is used. Each binary is
+ * opened in r2 and analyzed (aaa). Then pdz latency is measured for
+ * each function:
+ *  - cold: empty cache (r2retdec-bench subdirectory of the save directory
+ *    is created empty at the start, nothing else in it is touched),
+ *  - warm disk: result is read from the disk cache,
+ *  - warm memory: result is served from memory of the process,
+ * and throughput of whole-binary decompilation (pdzaa) is measured.
+ *
+ * RetDec support files are expected in the r2 plugin directory, where
+ * they are installed with the plugin.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <r_core.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2passprof.h"
+#include "r2plugin/r2retdec.h"
+
+#include "bench.h"
+
+using namespace retdec;
+using namespace retdec::r2plugin;
+using namespace retdec::r2plugin::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Pass in which a request is measured.
+enum Pass {
+	Cold = 0,
+	WarmDisk,
+	WarmMemory,
+	PassCount
+};
+
+const char* passNames[PassCount] = {"cold", "warm_disk", "warm_memory"};
+
+struct Samples {
+	std::vector<double> latency[PassCount];
+	double wholeSeconds = 0;
+	size_t wholeFunctions = 0;
+	uint64_t wholeBytes = 0;
+	size_t failures = 0;
+};
+
+/**
+ * Optimization level of the corpus binary (name-<level>) or "other".
+ */
+std::string groupOf(const fs::path& binary)
+{
+	auto stem = binary.stem().string();
+	auto dash = stem.rfind('-');
+	return dash != std::string::npos ? stem.substr(dash+1) : "other";
+}
+
+std::vector<fs::path> corpus(const Arguments& args)
+{
+	std::vector<fs::path> binaries;
+	for (auto& path: args.positional())
+		binaries.push_back(path);
+
+	if (!binaries.empty())
+		return binaries;
+
+	for (auto& entry: fs::directory_iterator(R2RETDEC_BENCH_CORPUS)) {
+		auto extension = entry.path().extension();
+		if (fs::is_regular_file(entry.path()) && (extension.empty() || extension == ".exe"))
+			binaries.push_back(entry.path());
+	}
+
+	std::sort(binaries.begin(), binaries.end());
+	return binaries;
+}
+
+double since(Clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+/**
+ * Decompiles the function and returns latency in milliseconds or
+ * a negative value when decompilation failed.
+ */
+double request(const R2Database& binInfo, const common::Function& fnc)
+{
+	auto start = Clock::now();
+	auto [code, _] = decompileFunction(binInfo, fnc);
+	auto latency = since(start);
+
+	if (code == nullptr)
+		return -1;
+
+	r_codemeta_free(code);
+	return latency;
+}
+
+void benchmarkBinary(const fs::path& binary, const Arguments& args, Samples& samples)
+{
+	RCore* core = r_core_new();
+	if (core == nullptr)
+		throw std::runtime_error("unable to create r2 core");
+
+	std::unique_ptr<RCore, decltype(&r_core_free)> guard(core, r_core_free);
+
+	r_config_set_i(core->config, "scr.interactive", 0);
+	if (!r_core_file_open(core, binary.string().c_str(), R_PERM_RX, 0)
+			|| !r_core_bin_load(core, binary.string().c_str(), UT64_MAX))
+		throw std::runtime_error("unable to open "+binary.string());
+
+	auto start = Clock::now();
+	r_core_cmd0(core, "aaa");
+	std::cout << binary.filename().string() << ": analysis " << since(start) << " ms" << std::flush;
+
+	R2Database binInfo(*core);
+
+	// Imports and thunks are not decompiled by users.
+	std::vector<common::Function> functions;
+	for (auto& fnc: binInfo.fetchFunctions()) {
+		if (fnc.getSize() != 0 && fnc.getName().rfind("imp.", 0) != 0)
+			functions.push_back(fnc);
+	}
+
+	auto maxFunctions = size_t(args.number("--max-functions", 25));
+	std::sort(functions.begin(), functions.end(), [](auto& a, auto& b) {
+		return a.getStart() < b.getStart();
+	});
+	if (functions.size() > maxFunctions)
+		functions.resize(maxFunctions);
+
+	std::vector<bool> decompiled(functions.size(), false);
+	for (size_t i = 0; i < functions.size(); i++) {
+		auto latency = request(binInfo, functions[i]);
+		if (latency < 0) {
+			samples.failures++;
+			continue;
+		}
+
+		decompiled[i] = true;
+		samples.latency[Cold].push_back(latency);
+	}
+
+	// Each result is read from disk first and then again from memory.
+	CodeCache::clearMemory();
+	for (size_t i = 0; i < functions.size(); i++) {
+		if (!decompiled[i])
+			continue;
+
+		auto disk = request(binInfo, functions[i]);
+		auto memory = request(binInfo, functions[i]);
+		if (disk >= 0)
+			samples.latency[WarmDisk].push_back(disk);
+		if (memory >= 0)
+			samples.latency[WarmMemory].push_back(memory);
+	}
+
+	std::cout << ", " << functions.size() << " functions" << std::flush;
+
+	if (!args.has("--skip-whole")) {
+		// Same as pdzaa, which never uses the cache.
+		auto config = createConfig(binInfo, "whole");
+		start = Clock::now();
+		auto [code, _] = decompile(config, false);
+		auto elapsed = since(start);
+
+		if (code == nullptr) {
+			samples.failures++;
+		}
+		else {
+			r_codemeta_free(code);
+			samples.wholeSeconds += elapsed / 1000;
+			samples.wholeFunctions += binInfo.fetchFunctions().size();
+			samples.wholeBytes += fs::file_size(binary);
+			std::cout << ", whole binary " << elapsed << " ms" << std::flush;
+		}
+	}
+
+	std::cout << std::endl;
+}
+
+uint64_t directorySize(const fs::path& dir)
+{
+	uint64_t size = 0;
+	std::error_code err;
+	for (auto& entry: fs::recursive_directory_iterator(dir, err)) {
+		if (fs::is_regular_file(entry.path(), err))
+			size += fs::file_size(entry.path(), err);
+	}
+
+	return size;
+}
+
+void addSamples(Report& report, const std::string& prefix, const Samples& samples)
+{
+	for (int pass = 0; pass < PassCount; pass++) {
+		auto& latency = samples.latency[pass];
+		if (latency.empty())
+			continue;
+
+		auto name = prefix + passNames[pass];
+		report.add(name + ":p50", percentile(latency, 0.50), "ms", Report::Better::Lower);
+		report.add(name + ":p95", percentile(latency, 0.95), "ms", Report::Better::Lower);
+		report.add(name + ":p99", percentile(latency, 0.99), "ms", Report::Better::Lower);
+		report.add(name + ":max", percentile(latency, 1.0), "ms", Report::Better::Lower);
+	}
+
+	if (samples.wholeSeconds > 0) {
+		report.add(prefix + "whole:throughput", samples.wholeFunctions / samples.wholeSeconds,
+			"functions/s", Report::Better::Higher);
+		report.add(prefix + "whole:byte_throughput", samples.wholeBytes / samples.wholeSeconds / 1024,
+			"KB/s", Report::Better::Higher);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Arguments args(argc, argv);
+
+	try {
+		// Cold requests need empty cache. Only the subdirectory owned
+		// by the benchmark is emptied, never the directory of the user.
+		auto saveDir = fs::path(args.get("--save-dir",
+			fs::temp_directory_path().string()))/"r2retdec-bench";
+
+		fs::remove_all(saveDir);
+		fs::create_directories(saveDir);
+		Environment::set("DEC_SAVE_DIR", saveDir.string());
+
+		std::map<std::string, Samples> groups;
+		for (auto& binary: corpus(args))
+			benchmarkBinary(binary, args, groups[groupOf(binary)]);
+
+		Samples all;
+		for (auto& [group, samples]: groups) {
+			for (int pass = 0; pass < PassCount; pass++) {
+				all.latency[pass].insert(all.latency[pass].end(),
+					samples.latency[pass].begin(), samples.latency[pass].end());
+			}
+			all.wholeSeconds += samples.wholeSeconds;
+			all.wholeFunctions += samples.wholeFunctions;
+			all.wholeBytes += samples.wholeBytes;
+			all.failures += samples.failures;
+		}
+
+		Report report("e2e");
+		report.setInfo("compiler", R2RETDEC_BENCH_COMPILER);
+
+		addSamples(report, "pdz/", all);
+		for (auto& [group, samples]: groups)
+			addSamples(report, group+"/pdz/", samples);
+
+		report.add("requests", all.latency[Cold].size(), "functions", Report::Better::Higher);
+		report.add("failures", all.failures, "requests", Report::Better::Lower);
+		report.add("peak_memory", PassProfiler::peakResidentMemory() / double(1 << 20), "MB", Report::Better::Lower);
+		report.add("cache_size", directorySize(saveDir) / double(1 << 20), "MB", Report::Better::Lower);
+
+		report.print();
+		if (args.has("--output"))
+			report.save(args.get("--output"));
+	}
+	catch (const std::exception& err) {
+		std::cerr << "benchmark failed: " << err.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,306 @@
+/**
+ * @file bench/micro.cpp
+ * @brief Microbenchmarks of hot paths of the plugin.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ *
+ * Usage: r2retdec-bench-micro [--min-time seconds] [--corpus dir]
+ *                             [--filter text] [--output report.json]
+ *
+ * Corpus directory may contain recorded RetDec outputs (*.json,
+ * as produced with json-human output format). They are benchmarked
+ * together with synthetic outputs of 1k, 10k and 100k tokens.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <rapidjson/document.h>
+#include <r_codemeta.h>
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2cgen.h"
+#include "r2plugin/r2retdec.h"
+#include "r2plugin/r2utils.h"
+
+#include "bench.h"
+
+using namespace retdec;
+using namespace retdec::r2plugin;
+using namespace retdec::r2plugin::bench;
+
+namespace {
+
+struct Output {
+	std::string name;
+	std::string json;
+};
+
+/**
+ * Generates RetDec output with the given number of tokens in the shape
+ * of real function bodies: every statement has its address and a mix
+ * of highlighted and plain tokens.
+ */
+std::string syntheticOutput(size_t tokens)
+{
+	std::ostringstream json;
+	json << "{\"language\":\"C\",\"tokens\":[";
+
+	size_t count = 0;
+	auto token = [&](const std::string& kind, const std::string& val) {
+		json << (count++ ? "," : "") << "{\"kind\":\"" << kind << "\",\"val\":\"" << val << "\"}";
+	};
+	auto addr = [&](uint64_t address) {
+		json << (count++ ? "," : "") << "{\"addr\":\"0x" << std::hex << address << std::dec << "\"}";
+	};
+
+	uint64_t address = 0x401000;
+	for (size_t line = 0; count < tokens; line++) {
+		if (line % 40 == 0) {
+			addr(address);
+			token("type", "int32_t");
+			token("ws", " ");
+			token("i_fnc", "function_" + std::to_string(address));
+			token("punc", "(");
+			token("type", "char");
+			token("ws", " ");
+			token("op", "*");
+			token("i_arg", "a1");
+			token("punc", ")");
+			token("ws", " ");
+			token("punc", "{");
+			token("nl", "\\n");
+			continue;
+		}
+
+		address += 4 + line % 7;
+		addr(address);
+		token("ws", "    ");
+		token("i_var", "v" + std::to_string(line % 17));
+		token("ws", " ");
+		token("op", "=");
+		token("ws", " ");
+		token("i_fnc", "helper_" + std::to_string(line % 23));
+		token("punc", "(");
+		token("l_int", std::to_string(line));
+		token("punc", ",");
+		token("ws", " ");
+		token("l_str", "\\\"text\\\"");
+		token("punc", ")");
+		token("punc", ";");
+		token("cmnt", " // line " + std::to_string(line));
+		token("nl", "\\n");
+	}
+
+	json << "]}";
+	return json.str();
+}
+
+std::vector<Output> loadCorpus(const std::string& dir)
+{
+	std::vector<Output> outputs;
+	if (dir.empty())
+		return outputs;
+
+	for (auto& entry: fs::directory_iterator(dir)) {
+		if (entry.path().extension() != ".json")
+			continue;
+
+		std::ifstream input(entry.path(), std::ios::binary);
+		std::stringstream content;
+		content << input.rdbuf();
+		outputs.push_back({entry.path().filename().string(), content.str()});
+	}
+
+	std::sort(outputs.begin(), outputs.end(), [](auto& a, auto& b) {
+		return a.json.size() < b.json.size();
+	});
+
+	return outputs;
+}
+
+/**
+ * Creates config resembling the one built by R2Database for a binary
+ * with the given number of functions.
+ */
+config::Config syntheticConfig(size_t functions)
+{
+	auto config = config::Config::empty();
+
+	for (size_t i = 0; i < functions; i++) {
+		common::Address start = 0x401000 + i*0x40;
+		common::Function fnc(start, start + 0x3f, "function_" + std::to_string(i));
+		fnc.setIsUserDefined();
+		fnc.returnType = common::Type("i32");
+		fnc.callingConvention = common::CallingConventionID::CC_CDECL;
+
+		for (int a = 0; a < 3; a++) {
+			common::Object arg("arg" + std::to_string(a), common::Storage::onStack(4 + 4*a));
+			arg.type = common::Type(a == 0 ? "i8*" : "i32");
+			fnc.parameters.push_back(arg);
+		}
+		for (int l = 0; l < 4; l++) {
+			common::Object var("var_" + std::to_string(4*l), common::Storage::onStack(-4 - 4*l));
+			var.type = common::Type("i32");
+			fnc.locals.insert(var);
+		}
+
+		config.functions.insert(fnc);
+	}
+
+	return config;
+}
+
+/**
+ * Exposes annotation of parsed output, which is protected in the generator.
+ */
+class Generator: public R2CGenerator {
+public:
+	using R2CGenerator::provideAnnotations;
+};
+
+class Suite {
+public:
+	Suite(const Arguments& args):
+		_minTime(args.number("--min-time", 0.5)),
+		_filter(args.get("--filter")),
+		_report("micro")
+	{
+	}
+
+	/**
+	 * Measures the operation and adds its time, allocations and,
+	 * when bytes are given, throughput to the report.
+	 */
+	void run(const std::string& name, const std::function<void()>& operation,
+			size_t bytes = 0, size_t items = 1)
+	{
+		if (!_filter.empty() && name.find(_filter) == std::string::npos)
+			return;
+
+		std::cout << name << std::flush;
+		auto result = measure(operation, _minTime);
+		std::cout << ": " << result.nsPerOp / items << " ns, "
+			<< result.allocationsPerOp / items << " allocations ("
+			<< result.iterations << " iterations)" << std::endl;
+
+		_report.add(name + ":time", result.nsPerOp / items, "ns/op", Report::Better::Lower);
+		_report.add(name + ":allocs", result.allocationsPerOp / items, "allocs/op", Report::Better::Lower);
+		_report.add(name + ":alloc_bytes", result.allocatedBytesPerOp / items, "B/op", Report::Better::Lower);
+		if (bytes != 0)
+			_report.add(name + ":throughput", bytes * result.opsPerSecond / (1 << 20), "MB/s", Report::Better::Higher);
+	}
+
+	Report& report()
+	{
+		return _report;
+	}
+
+private:
+	double _minTime;
+	std::string _filter;
+	Report _report;
+};
+
+void benchmarkAnnotations(Suite& suite, const std::string& corpus)
+{
+	std::vector<Output> outputs;
+	for (size_t tokens: {1000, 10000, 100000})
+		outputs.push_back({std::to_string(tokens/1000) + "k_tokens", syntheticOutput(tokens)});
+
+	for (auto& output: loadCorpus(corpus))
+		outputs.push_back(output);
+
+	Generator generator;
+	for (auto& output: outputs) {
+		rapidjson::Document root;
+		root.Parse(output.json.c_str());
+		if (root.HasParseError()) {
+			std::cerr << "skipping malformed output " << output.name << std::endl;
+			continue;
+		}
+
+		suite.run("annotations/" + output.name, [&generator, &root]() {
+			r_codemeta_free(generator.provideAnnotations(root));
+		}, output.json.size());
+
+		suite.run("parse_and_annotate/" + output.name, [&generator, &output]() {
+			r_codemeta_free(generator.generateOutputFromString(output.json));
+		}, output.json.size());
+	}
+}
+
+void benchmarkFormatUtils(Suite& suite)
+{
+	// Types as r2 reports them for variables and prototypes.
+	std::vector<std::string> cTypes = {
+		"int", "unsigned int", "const char *", "char **", "int64_t", "uint8_t",
+		"size_t", "struct stat *", "void *", "unsigned long long", "double",
+		"FILE *", "char[16]", "const unsigned char *", "void (*)(int)", "long"
+	};
+
+	// LLVM types as RetDec stores them in the config.
+	std::vector<std::string> llvmTypes = {
+		"i32", "i8*", "i8**", "i64", "i8", "i16", "double", "float", "void",
+		"%struct.stat*", "[16 x i8]", "i32*", "i1", "i64*", "%FILE*", "i8***"
+	};
+
+	// Names of functions and symbols in r2.
+	std::vector<std::string> names = {
+		"main", "sym.imp.printf", "fcn.00401000", "sym.main", "entry0",
+		"sym.std::vector_int_::push_back", "obj.__libc_csu_init", "sym.imp.__libc_start_main",
+		"loc.00401a3c", "sym._ZNSt6vectorIiSaIiEE9push_backERKi", "reloc.malloc",
+		"sub.memcpy_400", "sym.go.runtime.mallocgc", "method.Foo.bar"
+	};
+
+	suite.run("convert_type_to_llvm", [&cTypes]() {
+		for (auto& type: cTypes)
+			FormatUtils::convertTypeToLlvm(type);
+	}, 0, cTypes.size());
+
+	suite.run("convert_llvm_type_to_c", [&llvmTypes]() {
+		for (auto& type: llvmTypes)
+			FormatUtils::convertLlvmTypeToC(type);
+	}, 0, llvmTypes.size());
+
+	suite.run("strip_name", [&names]() {
+		for (auto& name: names)
+			FormatUtils::stripName(name);
+	}, 0, names.size());
+}
+
+void benchmarkHash(Suite& suite)
+{
+	for (size_t functions: {1000, 10000, 100000}) {
+		auto config = syntheticConfig(functions);
+		suite.run("construct_hash/" + std::to_string(functions/1000) + "k_functions", [&config]() {
+			std::ostringstream hash;
+			constructHash(config, hash);
+		});
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Arguments args(argc, argv);
+	Suite suite(args);
+
+	try {
+		benchmarkAnnotations(suite, args.get("--corpus"));
+		benchmarkFormatUtils(suite);
+		benchmarkHash(suite);
+
+		if (args.has("--output"))
+			suite.report().save(args.get("--output"));
+	}
+	catch (const std::exception& err) {
+		std::cerr << "benchmark failed: " << err.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
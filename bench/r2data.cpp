@@ -0,0 +1,301 @@
+/**
+ * @file bench/r2data.cpp
+ * @brief Scaling of conversion between r2 and RetDec data in R2Database.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ *
+ * Usage: r2retdec-bench-r2data [--sizes n,n,...] [--variables n]
+ *                              [--repeat n] [--output report.json]
+ *
+ * For each size N an r2 core is built in the process with N synthetic
+ * functions. Each function has a basic block, prototype, calling
+ * convention, stack arguments and locals and a symbol. Some of the
+ * functions are imported and there are N/2 global variables, a quarter
+ * of them renamed by flags. Then fetchFunctionsAndGlobals, fetchGlobals
+ * and setFunctions are timed. Default sizes are 1k, 10k, 100k and 500k.
+ *
+ * Allocations are counted only for C++ objects (RetDec config), growth
+ * of resident memory covers allocations made by r2 as well.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <r_core.h>
+#include <retdec/config/config.h>
+
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2governor.h"
+
+#include "bench.h"
+
+using namespace retdec;
+using namespace retdec::r2plugin;
+using namespace retdec::r2plugin::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const ut64 FunctionsBase = 0x100000;
+const ut64 FunctionSize = 0x40;
+const ut64 GlobalsBase = 0x80000000;
+
+const char* callingConventions[] = {"cdecl", "stdcall", "fastcall", "amd64"};
+const char* types[] = {"int", "char *", "unsigned int", "void *", "short"};
+
+/**
+ * Exposes fetching of globals, which is protected.
+ */
+class Database: public R2Database {
+public:
+	using R2Database::R2Database;
+	using R2Database::fetchGlobals;
+};
+
+struct Result {
+	double milliseconds;
+	double allocations;
+	double allocatedBytes;
+	double residentBytes;
+};
+
+std::vector<size_t> sizes(const Arguments& args)
+{
+	std::vector<size_t> result;
+	std::istringstream list(args.get("--sizes", "1000,10000,100000,500000"));
+	std::string size;
+	while (std::getline(list, size, ','))
+		result.push_back(std::stoul(size));
+
+	if (result.empty())
+		throw std::runtime_error("no sizes given");
+
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+std::string label(size_t size)
+{
+	if (size % 1000000 == 0)
+		return std::to_string(size / 1000000) + "M";
+	if (size % 1000 == 0)
+		return std::to_string(size / 1000) + "k";
+
+	return std::to_string(size);
+}
+
+std::string functionName(size_t i)
+{
+	return "fcn_" + std::to_string(i);
+}
+
+void addSymbol(RList* symbols, const std::string& name, ut64 addr, const char* type, bool imported)
+{
+	auto sym = r_bin_symbol_new(name.c_str(), addr - FunctionsBase, addr);
+	if (sym == nullptr)
+		throw std::runtime_error("unable to create symbol "+name);
+
+	sym->type = type;
+	sym->bind = "GLOBAL";
+	sym->is_imported = imported;
+	r_list_append(symbols, sym);
+}
+
+/**
+ * Creates r2 core with the given number of synthetic functions and
+ * globals. Nothing is read from the mapped file, it only provides
+ * the binary object holding symbols.
+ */
+RCore* syntheticCore(size_t functions, size_t variables)
+{
+	RCore* core = r_core_new();
+	if (core == nullptr)
+		throw std::runtime_error("unable to create r2 core");
+
+	std::unique_ptr<RCore, decltype(&r_core_free)> guard(core, r_core_free);
+
+	const char* uri = "malloc://4096";
+	r_config_set_i(core->config, "scr.interactive", 0);
+	if (!r_core_file_open(core, uri, R_PERM_RX, 0) || !r_core_bin_load(core, uri, FunctionsBase))
+		throw std::runtime_error("unable to open synthetic binary");
+
+	RBinObject* obj = r_bin_cur_object(core->bin);
+	if (obj == nullptr)
+		throw std::runtime_error("synthetic binary has no object");
+	if (obj->symbols == nullptr)
+		obj->symbols = r_list_newf(reinterpret_cast<RListFree>(r_bin_symbol_free));
+
+	for (size_t i = 0; i < functions; i++) {
+		auto name = functionName(i);
+		ut64 addr = FunctionsBase + i * FunctionSize;
+
+		auto fnc = r_anal_create_function(core->anal, name.c_str(), addr, R_ANAL_FCN_TYPE_FCN, nullptr);
+		if (fnc == nullptr)
+			throw std::runtime_error("unable to create function "+name);
+
+		r_anal_function_add_bb(core->anal, fnc, addr, FunctionSize, UT64_MAX, UT64_MAX, nullptr);
+
+		auto cc = callingConventions[i % std::size(callingConventions)];
+		fnc->cc = r_str_constpool_get(&core->anal->constpool, cc);
+
+		std::ostringstream prototype;
+		prototype << types[i % std::size(types)] << " " << name << "(";
+		for (size_t v = 0; v < variables; v++) {
+			bool isArg = v % 2 == 0;
+			auto type = types[(i + v) % std::size(types)];
+			auto var = (isArg ? "arg_" : "var_") + std::to_string(v);
+
+			// Arguments above the frame pointer, locals below the stack pointer.
+			int delta = isArg ? int(8 + 4 * v) : -int(4 + 4 * v);
+			r_anal_function_set_var(fnc, delta, isArg ? R_ANAL_VAR_KIND_BPV : R_ANAL_VAR_KIND_SPV,
+					type, 4, isArg, var.c_str());
+
+			if (isArg)
+				prototype << (v ? ", " : "") << type << " " << var;
+		}
+		prototype << ");";
+		r_anal_str_to_fcn(core->anal, fnc, prototype.str().c_str());
+
+		addSymbol(obj->symbols, name, addr, "FUNC", i % 8 == 7);
+	}
+
+	for (size_t i = 0; i < functions / 2; i++) {
+		auto name = "g_" + std::to_string(i);
+		ut64 addr = GlobalsBase + i * 8;
+		addSymbol(obj->symbols, name, addr, "OBJ", false);
+
+		if (i % 4 == 0)
+			r_flag_set(core->flags, ("obj.renamed_" + std::to_string(i)).c_str(), addr, 8);
+	}
+
+	return guard.release();
+}
+
+/**
+ * Runs the operation repeatedly and returns the fastest run. Memory
+ * is measured on the first one.
+ */
+Result run(size_t repeat, const std::function<void()>& operation)
+{
+	Result result = {0, 0, 0, 0};
+	for (size_t i = 0; i < repeat; i++) {
+		auto allocations = Allocations::now();
+		auto resident = Governor::residentMemory();
+		auto start = Clock::now();
+
+		operation();
+
+		std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+		if (i == 0) {
+			auto after = Allocations::now();
+			auto residentAfter = Governor::residentMemory();
+			result.milliseconds = elapsed.count();
+			result.allocations = after.count - allocations.count;
+			result.allocatedBytes = after.bytes - allocations.bytes;
+			result.residentBytes = residentAfter > resident ? residentAfter - resident : 0;
+		}
+		else {
+			result.milliseconds = std::min(result.milliseconds, elapsed.count());
+		}
+	}
+
+	return result;
+}
+
+void addResult(Report& report, const std::string& name, const Result& result)
+{
+	report.add(name + ":time", result.milliseconds, "ms", Report::Better::Lower);
+	report.add(name + ":allocs", result.allocations, "allocations", Report::Better::Lower);
+	report.add(name + ":alloc_bytes", result.allocatedBytes / (1 << 20), "MB", Report::Better::Lower);
+	report.add(name + ":resident", result.residentBytes / (1 << 20), "MB", Report::Better::Lower);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Arguments args(argc, argv);
+
+	try {
+		auto variables = size_t(args.number("--variables", 4));
+		auto repeat = std::max<size_t>(1, size_t(args.number("--repeat", 3)));
+		auto ns = sizes(args);
+
+		const char* operations[] = {"fetchFunctionsAndGlobals", "fetchGlobals", "setFunctions"};
+		std::map<std::string, std::vector<double>> curves;
+
+		Report report("r2data");
+		std::cout << std::left << std::setw(10) << "functions" << std::right
+			<< std::setw(12) << "setup ms";
+		for (auto op: operations)
+			std::cout << std::setw(28) << std::string(op) + " ms";
+		std::cout << std::endl;
+
+		for (auto n: ns) {
+			auto start = Clock::now();
+			std::unique_ptr<RCore, decltype(&r_core_free)> core(syntheticCore(n, variables), r_core_free);
+			std::chrono::duration<double, std::milli> setup = Clock::now() - start;
+
+			Database binInfo(*core);
+			config::Config functionsConfig;
+
+			std::map<std::string, Result> results;
+			results["fetchFunctionsAndGlobals"] = run(repeat, [&]() {
+				functionsConfig = config::Config();
+				binInfo.fetchFunctionsAndGlobals(functionsConfig);
+			});
+
+			if (functionsConfig.functions.size() != n)
+				throw std::runtime_error("fetched " + std::to_string(functionsConfig.functions.size())
+						+ " functions instead of " + std::to_string(n));
+
+			// Globals are fetched again on top of fetched functions, which
+			// repeats the same correction of imported functions.
+			results["fetchGlobals"] = run(repeat, [&]() {
+				binInfo.fetchGlobals(functionsConfig);
+			});
+
+			results["setFunctions"] = run(repeat, [&]() {
+				binInfo.setFunctions(functionsConfig);
+			});
+
+			std::cout << std::left << std::setw(10) << n << std::right << std::fixed
+				<< std::setprecision(1) << std::setw(12) << setup.count();
+			for (auto op: operations) {
+				auto& result = results[op];
+				addResult(report, std::string(op) + "/" + label(n), result);
+				curves[op].push_back(result.milliseconds);
+				std::cout << std::setw(28) << result.milliseconds;
+			}
+			std::cout << std::endl;
+		}
+
+		// Slope of time in log-log scale, 1 is linear scaling.
+		if (ns.size() > 1 && ns.front() != ns.back()) {
+			for (auto& [op, times]: curves) {
+				if (times.front() <= 0 || times.back() <= 0)
+					continue;
+
+				auto exponent = std::log(times.back() / times.front())
+					/ std::log(double(ns.back()) / ns.front());
+				report.add(op + ":scaling", exponent, "exponent", Report::Better::Lower);
+			}
+		}
+
+		report.print();
+		if (args.has("--output"))
+			report.save(args.get("--output"));
+	}
+	catch (const std::exception& err) {
+		std::cerr << "benchmark failed: " << err.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
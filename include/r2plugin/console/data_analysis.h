@@ -30,6 +30,9 @@ public:
 	/// Representation of pdzaa command.
 	static Console::Command AnalyzeWholeBinary;
 
+	/// Representation of pdzab command.
+	static Console::Command DecompileAllFunctions;
+
 private:
 	/// Implementation of pdza command.
 	static bool analyzeRange(const std::string&, const R2Database& info);
@@ -37,6 +40,9 @@ private:
 	/// Implementation of pdzaa command.
 	static bool analyzeWholeBinary(const std::string&, const R2Database& info);
 
+	/// Implementation of pdzab command.
+	static bool decompileAllFunctions(const std::string&, const R2Database& info);
+
 private:
 	/// Helper method. Parses arguments of pdza commnad.
 	static common::AddressRange parseRange(const std::string& range);
@@ -43,6 +43,33 @@ public:
 	/// Representation of pdze command.
 	static const Console::Command ShowUsedEnvironment;
 
+	/// Representation of pdzi command.
+	static const Console::Command QueryIndexCurrent;
+
+	/// Representation of pdzp command.
+	static const Console::Command ShowProfiles;
+
+	/// Representation of pdzb command.
+	static const Console::Command ShowBudgetStatistics;
+
+	/// Representation of pdzc command.
+	static const Console::Command CancelRunning;
+
+	/// Representation of pdzd command.
+	static const Console::Command DiffPrevious;
+
+	/// Representation of pdzl command.
+	static const Console::Command LibrarySignatures;
+
+	/// Representation of pdzs command.
+	static const Console::Command ShowPhaseStatistics;
+
+	/// Representation of pdzr command.
+	static const Console::Command ShowPassProfile;
+
+	/// Representation of pdzm command.
+	static const Console::Command ShowMetrics;
+
 private:
 	/// Implementation of pdz command.
 	static bool decompileCurrent(const std::string&, const R2Database& info);
@@ -59,7 +86,37 @@ private:
 	/// Implementation of pdze command.
 	static bool showEnvironment(const std::string&, const R2Database&);
 
-	static config::Config createConsoleConfig(const R2Database& binInfo);
+	/// Implementation of pdzi command.
+	static bool queryIndexCurrent(const std::string&, const R2Database& info);
+
+	/// Implementation of pdzp command.
+	static bool showProfiles(const std::string&, const R2Database&);
+
+	/// Implementation of pdzb command.
+	static bool showBudgetStatistics(const std::string&, const R2Database&);
+
+	/// Implementation of pdzc command.
+	static bool cancelRunning(const std::string&, const R2Database&);
+
+	/// Implementation of pdzd command.
+	static bool diffPrevious(const std::string&, const R2Database& info);
+
+	/// Implementation of pdzl command.
+	static bool librarySignatures(const std::string&, const R2Database& info);
+
+	/// Implementation of pdzs command.
+	static bool showPhaseStatistics(const std::string&, const R2Database&);
+
+	/// Implementation of pdzr command.
+	static bool showPassProfile(const std::string&, const R2Database& info);
+
+	/// Implementation of pdzm command.
+	static bool showMetrics(const std::string&, const R2Database&);
+
+	static std::pair<RCodeMeta*, config::Config> decompileSeeked(
+			const R2Database& binInfo,
+			const std::string& command,
+			CodeIndex* index = nullptr);
 
 private:
 	/// Singleton.
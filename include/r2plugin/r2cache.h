@@ -0,0 +1,91 @@
+/**
+ * @file include/r2plugin/r2cache.h
+ * @brief Compact binary cache of decompilation results.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2CACHE_H
+#define RETDEC_R2PLUGIN_R2CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <r_codemeta.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2index.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Stores annotated code produced by R2CGenerator in a compact binary
+ * format. Cache hit is then only read of the file and copy of the packed
+ * annotations into RCodeMeta instead of parsing RetDec's JSON output.
+ *
+ * Layout of the file (host byte order, detected by byte order mark):
+ *
+ *     Header | key | code | PackedItem[itemCount] | CodeIndex
+ *
+ * The key identifies configuration the result was created from (hash
+ * of RetDec config). Checksum covers everything after the header.
+ *
+ * Recently used results are also kept in memory so that repeated
+ * requests for the same function do not touch the disk at all.
+ */
+class CodeCache {
+public:
+	/// File format version. Bumped on each change of the layout.
+	static const uint16_t Version;
+
+	/// Single annotation as it is stored in the file.
+	struct PackedItem {
+		uint64_t start;
+		uint64_t end;
+		uint64_t payload;
+		uint32_t type;
+		uint32_t reserved;
+	};
+
+public:
+	static void save(
+			const fs::path& path,
+			const std::string& key,
+			const RCodeMeta& code,
+			const CodeIndex& index);
+	static RCodeMeta* load(
+			const fs::path& path,
+			const std::string& key,
+			CodeIndex* index = nullptr);
+
+	static std::vector<uint8_t> serialize(
+			const std::string& key,
+			const RCodeMeta& code,
+			const CodeIndex& index);
+	static RCodeMeta* deserialize(
+			const std::vector<uint8_t>& data,
+			const std::string& key,
+			CodeIndex* index = nullptr);
+
+	static uint64_t checksum(const uint8_t* data, size_t size);
+
+	static void clearMemory();
+
+protected:
+	static const std::vector<uint8_t>* memoryLookup(const std::string& path);
+	static void memoryStore(const std::string& path, std::vector<uint8_t> data);
+
+private:
+	/// Maximal number of results kept in memory.
+	static const size_t _memoryCapacity;
+	static std::list<std::pair<std::string, std::vector<uint8_t>>> _memory;
+	static std::map<std::string, decltype(_memory)::iterator> _memoryIndex;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2CACHE_H*/
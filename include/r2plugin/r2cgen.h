@@ -19,6 +19,7 @@ namespace r2plugin {
 class R2CGenerator {
 public:
 	RCodeMeta* generateOutput(const std::string &rdoutJson) const;
+	RCodeMeta* generateOutputFromString(const std::string &jsonContent) const;
 
 protected:
 	RCodeMeta* provideAnnotations(const rapidjson::Document &root) const;
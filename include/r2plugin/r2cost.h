@@ -0,0 +1,121 @@
+/**
+ * @file include/r2plugin/r2cost.h
+ * @brief Cost model of decompilation of a single function.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2COST_H
+#define RETDEC_R2PLUGIN_R2COST_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2profile.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Estimated cost of decompilation and resources assigned to it.
+ */
+struct CostEstimate {
+	/// Calibrated estimate of the decompilation time.
+	double milliseconds;
+	std::string profile;
+	/// Timeout in seconds.
+	uint64_t timeout;
+	/// Memory limit in bytes.
+	uint64_t memoryLimit;
+};
+
+/**
+ * Estimates cost of decompilation of a function from metrics known
+ * to Radare2 and selects pipeline profile and limits accordingly.
+ *
+ * Used when the profile is set to auto. Trivial functions are decompiled
+ * by the fast profile as the full pipeline gives them no better output,
+ * outliers by cheaper profiles so that they do not stall the session.
+ *
+ * Each decompilation run by RetDec is recorded together with its
+ * estimate into rd_cost.csv in the output directory. Ratios of actual
+ * and estimated times from the recent records calibrate the model,
+ * separately for each profile. Tier is selected by the time calibrated
+ * for the default profile.
+ */
+class CostModel {
+private:
+	~CostModel();
+
+public:
+	static CostEstimate estimate(const R2FunctionMetrics& metrics);
+
+	static void expect(
+			const std::string& job,
+			const std::string& function,
+			const R2FunctionMetrics& metrics,
+			const CostEstimate& estimate);
+	static void observe(const std::string& job, double milliseconds);
+	static void forget(const std::string& job);
+
+	static double calibration(const std::string& profile = Profile::DefaultName);
+
+	/**
+	 * Forgets estimate of the job that was not observed (it was served
+	 * from a cache or failed) when the object is destroyed.
+	 */
+	class Expectation {
+	public:
+		Expectation(const std::string& job);
+		~Expectation();
+
+		Expectation(const Expectation&) = delete;
+		Expectation& operator=(const Expectation&) = delete;
+
+	private:
+		std::string _job;
+	};
+
+public:
+	/// Name of the profile that selects profile by the cost model.
+	static const std::string ProfileName;
+
+protected:
+	static double uncalibrated(const R2FunctionMetrics& metrics);
+	static fs::path logPath();
+	static void loadRatios();
+
+private:
+	/// Estimate waiting for the result of decompilation.
+	struct Pending {
+		std::string function;
+		R2FunctionMetrics metrics;
+		CostEstimate estimate;
+	};
+
+	/// Profile used for estimates up to the cost.
+	struct Tier {
+		double milliseconds;
+		std::string profile;
+	};
+
+	/// Maximal number of recent records used for calibration.
+	static const size_t CalibrationWindow;
+
+	static const std::vector<Tier> _tiers;
+
+	static std::mutex _mutex;
+	static std::map<std::string, Pending> _pending;
+	/// Recent ratios of actual and uncalibrated times by profile.
+	static std::map<std::string, std::vector<double>> _ratios;
+	static bool _ratiosLoaded;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2COST_H*/
@@ -10,6 +10,7 @@
 #include <exception>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <r_core.h>
 #include <r_anal.h>
@@ -21,6 +22,48 @@ namespace r2plugin {
 
 using R2Address = ut64;
 
+/**
+ * Section of the input binary together with its placement in memory.
+ */
+struct R2Section {
+	std::string name;
+	R2Address vaddr;
+	ut64 vsize;
+	ut64 paddr;
+	ut64 size;
+	int perm;
+};
+
+/**
+ * Architecture of the analyzed code.
+ */
+struct R2Architecture {
+	std::string name;
+	size_t bits;
+	bool bigEndian;
+};
+
+/**
+ * Reference from code of a function to other code or data.
+ */
+struct R2Reference {
+	std::string type;
+	R2Address from;
+	R2Address to;
+	/// Name of the flag at the target, empty when there is none.
+	std::string name;
+};
+
+/**
+ * Size and shape of a function as seen by Radare2's analysis.
+ */
+struct R2FunctionMetrics {
+	size_t instructions;
+	size_t blocks;
+	size_t complexity;
+	size_t callees;
+};
+
 /**
  * R2Database implements wrapper around R2 API functions.
  */
@@ -32,6 +75,7 @@ public:
 	std::string fetchFilePath() const;
 
 	void setFunction(const common::Function &fnc) const;
+	void renameFunction(R2Address addr, const std::string& name) const;
 	void copyFunctionData(const common::Function &fnc, RAnalFunction& r2fnc) const;
 
 	void setFunctions(const config::Config &rdconfig) const;
@@ -45,6 +89,17 @@ public:
 	void fetchFunctionCallingconvention(common::Function &function, RAnalFunction &r2fnc) const;
 	void fetchFunctionReturnType(common::Function &function, RAnalFunction &r2fnc) const;
 	size_t fetchWordSize() const;
+
+	R2Architecture fetchArchitecture() const;
+	std::vector<R2Section> fetchSections() const;
+	std::vector<R2Reference> fetchFunctionReferences(R2Address addr) const;
+	R2FunctionMetrics fetchFunctionMetrics(const common::Function& fnc) const;
+	std::vector<uint8_t> fetchFileBytes() const;
+	std::string fetchIOState() const;
+	std::vector<uint8_t> fetchBytes(R2Address addr, size_t size) const;
+	std::vector<uint8_t> fetchNormalizedBytes(const common::Function& fnc) const;
+	void normalizeBytes(std::vector<uint8_t>& bytes, R2Address addr) const;
+	std::vector<common::Function> fetchFunctions() const;
 	R2Address seekedAddress() const;
 	const RCore& core() const;
 
@@ -0,0 +1,87 @@
+/**
+ * @file include/r2plugin/r2dedup.h
+ * @brief Sharing of decompilation results between identical functions.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2DEDUP_H
+#define RETDEC_R2PLUGIN_R2DEDUP_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <r_codemeta.h>
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2index.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Stores decompiled functions under a hash of their normalized bytes
+ * so that duplicates (statically linked runtimes, template instances,
+ * SDK code) are decompiled only once, within a binary and across
+ * binaries.
+ *
+ * Key consists of normalized bytes of the function (placement dependent
+ * operands masked by r2), relative positions and names of referenced
+ * objects, prototype and variables of the function set in r2,
+ * architecture and pipeline. Result found under the key is rebased
+ * from the function it was created for: offsets are shifted and its
+ * name is replaced. Results that contain addresses in their text are
+ * not shared.
+ *
+ * Store is located in the dedup directory of the output directory
+ * and is used with $DEC_DEDUP set.
+ */
+class DedupStore {
+private:
+	~DedupStore();
+
+public:
+	static bool isEnabled();
+
+	static std::string key(
+			const R2Database& binInfo,
+			const common::Function& fnc,
+			const config::Config& config);
+
+	static bool contains(const std::string& key);
+	static RCodeMeta* lookup(
+			const std::string& key,
+			const common::Function& fnc,
+			CodeIndex* index = nullptr);
+	static bool store(
+			const R2Database& binInfo,
+			const std::string& key,
+			const common::Function& fnc,
+			const RCodeMeta& code);
+
+	static RCodeMeta* rebase(
+			const RCodeMeta& code,
+			const common::Function& from,
+			const common::Function& to,
+			std::map<std::string, std::string> renames = {});
+
+	static uint64_t hits();
+
+protected:
+	static fs::path storePath(const std::string& key);
+	static bool embedsAddresses(
+			const RCodeMeta& code,
+			const common::Function& fnc,
+			const std::vector<R2Reference>& references);
+
+private:
+	static std::atomic<uint64_t> _hits;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2DEDUP_H*/
@@ -0,0 +1,137 @@
+/**
+ * @file include/r2plugin/r2diff.h
+ * @brief Differential decompilation between two builds of a binary.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2DIFF_H
+#define RETDEC_R2PLUGIN_R2DIFF_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Description of a decompiled function in the manifest of a binary.
+ */
+struct ManifestEntry {
+	common::Function function;
+	/// Hash of normalized bytes of the function.
+	uint64_t hash = 0;
+	std::vector<R2Reference> references;
+	/// Hash of content of the referenced data and strings.
+	uint64_t dataHash = 0;
+	/// Location and key of the cached result, empty when there is none.
+	std::string cachePath;
+	std::string cacheKey;
+	/// Key of the result in DedupStore when it was served from there.
+	std::string dedupKey;
+};
+
+/**
+ * Functions of a binary processed in a bulk mode together with
+ * locations of their cached results.
+ *
+ * Manifest is stored as rd_manifest.tsv in the directory of the binary
+ * in the output directory and allows to carry results forward to the
+ * next build of the binary.
+ */
+class Manifest {
+public:
+	static fs::path path(const fs::path& binaryDir);
+
+	static Manifest load(const fs::path& file);
+	void save(const fs::path& file) const;
+
+	static ManifestEntry describe(const R2Database& binInfo, const common::Function& fnc);
+
+	void add(ManifestEntry entry);
+	void record(const R2Database& binInfo, R2Address start, const config::Config& config);
+	bool resume(R2Address start, const Manifest& previous);
+	void setProfile(const std::string& profile);
+
+	const ManifestEntry* find(R2Address start) const;
+	const std::map<R2Address, ManifestEntry>& entries() const;
+
+private:
+	std::map<R2Address, ManifestEntry> _entries;
+	/// Profile the results were decompiled with.
+	std::string _profile;
+
+	/// Bytes of each referenced data object taken into ManifestEntry::dataHash.
+	static const size_t ReferencedDataSize;
+};
+
+/**
+ * Function of the new build compared to the previous one.
+ */
+struct FunctionChange {
+	enum class Kind {
+		Identical,
+		Changed,
+		Added,
+		Removed
+	};
+
+	Kind kind;
+	/// Empty for added functions.
+	ManifestEntry previous;
+	/// Empty for removed functions.
+	ManifestEntry current;
+};
+
+/**
+ * Matches functions of two builds of the same binary and decompiles only
+ * functions that are new or changed.
+ *
+ * Functions are matched by unique hashes of their normalized bytes,
+ * then by unique names given by symbols and at last by their position
+ * in the call graph relative to already matched functions. Results
+ * of identical functions (including the data they reference) are
+ * carried forward from the cache or the dedup store of the previous
+ * build with offsets and names rebased.
+ */
+class BinaryDiff {
+private:
+	~BinaryDiff();
+
+public:
+	static std::vector<FunctionChange> compare(
+			const Manifest& previous,
+			const Manifest& current);
+
+	static std::vector<FunctionChange> update(
+			const R2Database& binInfo,
+			const fs::path& previousDir);
+
+	static std::string kindName(FunctionChange::Kind kind);
+
+protected:
+	static std::map<std::string, std::string> renames(
+			const ManifestEntry& previous,
+			const ManifestEntry& current,
+			const Manifest& previousManifest,
+			const Manifest& currentManifest);
+
+	static bool carryForward(
+			const R2Database& binInfo,
+			const FunctionChange& change,
+			const std::map<std::string, std::string>& names,
+			Manifest& current);
+
+	static void report(const std::vector<FunctionChange>& changes, const fs::path& file);
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2DIFF_H*/
@@ -0,0 +1,54 @@
+/**
+ * @file include/r2plugin/r2env.h
+ * @brief Environment variables customizing behavior of the plugin.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2ENV_H
+#define RETDEC_R2PLUGIN_R2ENV_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Provides access to environment variables used by the plugin.
+ *
+ * Variables are read on each use. This allows user to change them
+ * for the running session through the pdze command.
+ */
+class Environment {
+private:
+	~Environment();
+
+public:
+	/// Description of a variable recognized by the plugin.
+	struct Variable {
+		std::string name;
+		std::string help;
+		std::string defaultValue = "";
+	};
+
+public:
+	static std::string get(const std::string& name);
+	static bool isEnabled(const std::string& name);
+	static uint64_t number(const std::string& name);
+
+	static void set(const std::string& name, const std::string& value);
+
+	static const std::vector<Variable>& variables();
+
+private:
+	static const Variable* find(const std::string& name);
+
+private:
+	static const std::vector<Variable> _variables;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2ENV_H*/
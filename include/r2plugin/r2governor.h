@@ -0,0 +1,146 @@
+/**
+ * @file include/r2plugin/r2governor.h
+ * @brief Time and memory budgets of decompilations.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2GOVERNOR_H
+#define RETDEC_R2PLUGIN_R2GOVERNOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Resources a single decompilation may use. Zero means unlimited.
+ */
+struct Budget {
+	/// Wall-clock time in milliseconds.
+	uint64_t milliseconds = 0;
+	/// Growth of resident memory of the process in bytes.
+	uint64_t memory = 0;
+
+	bool isLimited() const;
+	Budget tightened(const Budget& other) const;
+
+	static Budget session();
+};
+
+/**
+ * Thrown when decompilation was stopped because it exceeded its budget.
+ */
+class BudgetExceeded: public DecompilationError {
+public:
+	BudgetExceeded(const std::string &msg) : DecompilationError(msg) {}
+};
+
+/**
+ * Thrown when decompilation was cancelled by the user or superseded
+ * by another request.
+ */
+class DecompilationCancelled: public DecompilationError {
+public:
+	DecompilationCancelled() : DecompilationError("decompilation cancelled") {}
+};
+
+/**
+ * Enforces budgets of decompilations run by RetDec and cancels them
+ * on request.
+ *
+ * RetDec cannot be interrupted from the outside. The governor therefore
+ * inserts checkpoint passes between LLVM passes of the pipeline. When
+ * the running decompilation exceeds its budget or is cancelled,
+ * the checkpoint strips bodies of all functions in the module so that
+ * the remaining passes finish immediately, and the output is discarded.
+ *
+ * Cancellation is requested by cancel (pdzc, superseding request
+ * from Iaito) or by r2's break signal (Ctrl-C) while ConsoleBreak
+ * is alive.
+ *
+ * Budget and cancellation are checked only between passes. A single long
+ * pass is thus noticed only after it finishes.
+ */
+class Governor {
+private:
+	~Governor();
+
+public:
+	/// Pipeline that finished the decompilation.
+	enum class Tier {
+		Requested = 0,
+		Degraded,
+		Failed
+	};
+
+	/**
+	 * Runs the governor for the lifetime of the scope. Only one
+	 * decompilation is governed at a time.
+	 */
+	class Scope {
+	public:
+		Scope(const Budget& budget);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	/**
+	 * Makes r2's break signal cancel decompilations for the lifetime
+	 * of the object. Used for commands run from r2 console.
+	 */
+	class ConsoleBreak {
+	public:
+		ConsoleBreak();
+		~ConsoleBreak();
+
+		ConsoleBreak(const ConsoleBreak&) = delete;
+		ConsoleBreak& operator=(const ConsoleBreak&) = delete;
+	};
+
+public:
+	static void insertCheckpoints(config::Config& config);
+	static bool checkpoint();
+	static std::string exceeded();
+
+	static void cancel();
+	static bool isCancelled();
+	static void forgetCancellation();
+
+	static void record(Tier tier);
+	static std::array<uint64_t, 3> statistics();
+
+	static uint64_t residentMemory();
+
+public:
+	/// Name of the LLVM pass that checks the budget.
+	static const std::string CheckpointPass;
+
+	/// Profile used for the retry after the budget was exceeded.
+	static const std::string FallbackProfile;
+
+private:
+	static Budget _budget;
+	static std::chrono::steady_clock::time_point _start;
+	static uint64_t _baseMemory;
+	static std::string _exceeded;
+	static bool _consoleBreak;
+	static std::atomic<bool> _running;
+	static std::atomic<bool> _cancelRequested;
+	static bool _cancelled;
+	static std::array<std::atomic<uint64_t>, 3> _statistics;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2GOVERNOR_H*/
@@ -0,0 +1,113 @@
+/**
+ * @file include/r2plugin/r2image.h
+ * @brief Input images for RetDec created from the state of Radare2.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2IMAGE_H
+#define RETDEC_R2PLUGIN_R2IMAGE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Creates input files for RetDec from data that Radare2 already holds
+ * in memory.
+ *
+ * RetDec accepts only a path to the input file. Images are therefore
+ * written into the output directory under a name derived from their
+ * content. Unchanged image is written only once. Image of the IO
+ * is built once per I/O state in the session. Checksum of the input
+ * file becomes part of the cache key of decompilation results.
+ *
+ * With in-memory output slim images are kept in memory and written
+ * only for the lifetime of an InputImage::Scope around the RetDec run.
+ */
+class InputImage {
+private:
+	~InputImage();
+
+public:
+	/// Continuous part of memory placed into a slim image.
+	struct Chunk {
+		R2Address address;
+		std::vector<uint8_t> bytes;
+		int perm;
+	};
+
+	/**
+	 * Writes the in-memory image of the input for the lifetime
+	 * of the object and removes it afterwards. Does nothing for inputs
+	 * that are not kept in memory.
+	 */
+	class Scope {
+	public:
+		Scope(const fs::path& input);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		fs::path _written;
+	};
+
+	/// Machine description written into the ELF header of a slim image.
+	struct Target {
+		uint16_t machine;
+		uint32_t flags;
+		bool is64;
+		bool bigEndian;
+	};
+
+public:
+	static fs::path fromIO(const R2Database& binInfo, const fs::path& outDir);
+	static fs::path slim(
+			const R2Database& binInfo,
+			const common::Function& fnc,
+			const fs::path& outDir,
+			bool inMemory = false);
+
+	static uint64_t checksum(const fs::path& file);
+
+protected:
+	static fs::path imagePath(const std::vector<uint8_t>& image, const fs::path& outDir);
+	static fs::path store(const std::vector<uint8_t>& image, const fs::path& outDir);
+	static void write(const std::vector<uint8_t>& image, const fs::path& path);
+
+	static Target targetFor(const R2Architecture& arch);
+	static std::vector<Chunk> slimChunks(
+			const R2Database& binInfo,
+			const common::Function& fnc);
+	static std::vector<uint8_t> createElf(
+			const Target& target,
+			R2Address entry,
+			const std::vector<Chunk>& chunks);
+
+private:
+	/// Granularity of memory placed into slim images.
+	static const R2Address PageSize;
+
+	/// Images created by fromIO by the I/O state they reflect.
+	static std::map<std::string, fs::path> _ioImages;
+	/// Checksums of input files by their path, size and modification time.
+	static std::map<std::string, uint64_t> _checksums;
+	/// Checksums of images created in the session by their path.
+	static std::map<fs::path, uint64_t> _imageChecksums;
+	/// The last slim image kept in memory and its path.
+	static std::pair<fs::path, std::vector<uint8_t>> _inMemory;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2IMAGE_H*/
@@ -0,0 +1,75 @@
+/**
+ * @file include/r2plugin/r2index.h
+ * @brief Mapping between positions in decompiled code and addresses.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2INDEX_H
+#define RETDEC_R2PLUGIN_R2INDEX_H
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <r_codemeta.h>
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Sorted indexes built from offset annotations of decompiled function.
+ *
+ * Provides mapping from code positions to addresses and from addresses
+ * to lines of code in logarithmic time. This is used to synchronize
+ * disassembly and decompiled views instead of scanning all annotations.
+ */
+class CodeIndex {
+public:
+	/// Range of code that belongs to address.
+	struct Range {
+		uint64_t start;
+		uint64_t end;
+		uint64_t address;
+	};
+
+	/// Line of code and the first address that belongs to it.
+	struct Line {
+		uint64_t start;
+		uint64_t address;
+	};
+
+public:
+	CodeIndex() = default;
+	CodeIndex(const RCodeMeta& code);
+
+	std::optional<uint64_t> addressAt(uint64_t position) const;
+	size_t lineAt(uint64_t position) const;
+	std::vector<size_t> linesOf(uint64_t address) const;
+	RVector* lineOffsets() const;
+
+	const std::vector<Range>& ranges() const;
+	const std::vector<Line>& lines() const;
+	const std::vector<std::pair<uint64_t, uint64_t>>& addressLines() const;
+
+	void serialize(std::vector<uint8_t>& out) const;
+	static std::optional<CodeIndex> deserialize(
+			const uint8_t* data,
+			size_t size,
+			size_t rangeCount,
+			size_t lineCount,
+			size_t addressLineCount);
+
+private:
+	/// Offset annotations sorted by start position.
+	std::vector<Range> _ranges;
+	/// Lines of code in order of appearance.
+	std::vector<Line> _lines;
+	/// Pairs (address, line) sorted by address.
+	std::vector<std::pair<uint64_t, uint64_t>> _addressLines;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2INDEX_H*/
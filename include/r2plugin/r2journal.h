@@ -0,0 +1,110 @@
+/**
+ * @file include/r2plugin/r2journal.h
+ * @brief Journal of bulk decompilation that allows to resume it.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2JOURNAL_H
+#define RETDEC_R2PLUGIN_R2JOURNAL_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Per-function record of a bulk decompilation (pdzab, r2retdec-batch).
+ *
+ * Journal is stored as rd_journal_<mode>.tsv in the directory of the binary
+ * in the output directory, next to the cache. It starts with the checksum
+ * of the content of the binary, journal of another content (the binary was
+ * rebuilt at the same path) is discarded on open. Each event is appended as
+ * a line and flushed immediately, so that the journal survives the process
+ * being killed:
+ *     start status seconds name
+ * where status is one of started, done, failed or aborted. Aborted attempt
+ * (cancelled, or stopped by the budget) is not counted as unfinished and
+ * the function is decompiled again by the next run.
+ *
+ * Rerun skips functions that are done and functions that are known to
+ * fail: decompilation failed or it was started MaxUnfinished times without
+ * finishing (it repeatedly crashed or ran out of memory).
+ */
+class Journal {
+public:
+	enum class Status {
+		Started,
+		Done,
+		Failed,
+		Aborted
+	};
+
+	struct Entry {
+		Status status = Status::Started;
+		/// Attempts that were started and did not finish.
+		unsigned unfinished = 0;
+		double seconds = 0;
+	};
+
+	/// Unfinished attempts after which the function is known to fail.
+	static const unsigned MaxUnfinished;
+
+public:
+	static fs::path path(const fs::path& binaryDir, const std::string& mode);
+
+	static Journal open(const fs::path& file, uint64_t binary);
+	void clear();
+
+	void start(const common::Function& fnc);
+	void finish(const common::Function& fnc, bool success, double seconds);
+	void abandon(const common::Function& fnc);
+	void abort(const common::Function& fnc, double seconds);
+
+	bool isDone(R2Address start) const;
+	bool isFailing(R2Address start) const;
+
+	size_t done() const;
+	size_t failing() const;
+	const fs::path& file() const;
+
+protected:
+	void append(const common::Function& fnc, Status status, double seconds);
+	void appendLine(const std::string& line);
+	static std::string statusName(Status status);
+	static std::string binaryLine(uint64_t binary);
+
+private:
+	fs::path _file;
+	uint64_t _binary = 0;
+	std::map<R2Address, Entry> _entries;
+};
+
+/**
+ * Logs progress of a bulk decompilation with estimated remaining time
+ * at most once in the interval.
+ */
+class ProgressReporter {
+public:
+	ProgressReporter(size_t total, std::chrono::seconds interval = std::chrono::seconds(10));
+
+	void update(size_t processed, size_t failed, bool force = false);
+
+	static std::string formatDuration(double seconds);
+
+private:
+	size_t _total;
+	std::chrono::seconds _interval;
+	std::chrono::steady_clock::time_point _start;
+	std::chrono::steady_clock::time_point _last;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2JOURNAL_H*/
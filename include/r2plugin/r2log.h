@@ -0,0 +1,93 @@
+/**
+ * @file include/r2plugin/r2log.h
+ * @brief In-memory logging of RetDec decompilation jobs.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2LOG_H
+#define RETDEC_R2PLUGIN_R2LOG_H
+
+#include <deque>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Stream buffer that keeps only a bounded number of recent lines.
+ */
+class LogBuffer: public std::streambuf {
+public:
+	LogBuffer(size_t capacity);
+
+	const std::deque<std::string>& lines() const;
+	void dump(const fs::path& path) const;
+
+protected:
+	int overflow(int c) override;
+	std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+private:
+	void pushLine();
+
+private:
+	size_t _capacity;
+	std::deque<std::string> _lines;
+	std::string _current;
+};
+
+/**
+ * Redirects RetDec's loggers into in-memory buffers for the lifetime
+ * of a decompilation job.
+ *
+ * When the guard is destroyed the console loggers are restored.
+ * Buffers are written into rd_out.log and rd_err.log in the dump
+ * directory only when the job fails (guard is destroyed by an exception)
+ * or when user requested it by setting DEC_LOG_DUMP.
+ *
+ * RetDec replaces its loggers when the decompilation starts. Pass
+ * inserted in front of the pipeline by insertPass installs the buffers
+ * of the active guard again.
+ */
+class LogGuard {
+public:
+	LogGuard(const fs::path& dumpDir);
+	~LogGuard();
+
+	LogGuard(const LogGuard&) = delete;
+	LogGuard& operator=(const LogGuard&) = delete;
+
+	void install();
+	void dump() const;
+
+	static void insertPass(config::Config& config);
+	static void reinstall();
+	static bool isVerbose();
+
+public:
+	/// Name of the LLVM pass that installs buffers of the active guard.
+	static const std::string InstallPass;
+
+private:
+	static LogGuard* _active;
+
+	fs::path _dumpDir;
+	int _exceptions;
+	bool _infoEnabled;
+
+	LogBuffer _infoBuffer;
+	LogBuffer _errorBuffer;
+	std::ostream _infoStream;
+	std::ostream _errorStream;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2LOG_H*/
@@ -0,0 +1,114 @@
+/**
+ * @file include/r2plugin/r2metrics.h
+ * @brief Latency histograms and counters of the decompiler.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2METRICS_H
+#define RETDEC_R2PLUGIN_R2METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "r2plugin/r2stats.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Histogram of values with buckets of bounded relative size
+ * (in the manner of HdrHistogram).
+ *
+ * Values below SubBuckets have a bucket each. Each following power
+ * of two is split into SubBuckets/2 buckets of the same width, so that
+ * the value reported for a percentile is never more than 1/16 above
+ * the recorded one. All 64-bit values fit in fixed number of buckets.
+ */
+class Histogram {
+public:
+	void record(uint64_t value);
+	void reset();
+
+	uint64_t count() const;
+	uint64_t min() const;
+	uint64_t max() const;
+	double mean() const;
+	uint64_t percentile(double p) const;
+
+public:
+	static const unsigned SubBucketBits = 5;
+	static const unsigned SubBuckets = 1 << SubBucketBits;
+	static const unsigned Buckets = SubBuckets + (64 - SubBucketBits) * (SubBuckets/2);
+
+private:
+	static unsigned bucket(uint64_t value);
+	static uint64_t highestValue(unsigned bucket);
+
+private:
+	std::array<uint64_t, Buckets> _buckets = {};
+	uint64_t _count = 0;
+	uint64_t _min = 0;
+	uint64_t _max = 0;
+	double _sum = 0;
+};
+
+/**
+ * Counters and latency histograms of phases of requests since the start
+ * of the session or the last reset, dumped as JSON by pdzm for
+ * monitoring of headless (r2pipe) sessions.
+ *
+ * Unlike Stats, histograms keep all samples, values are in microseconds.
+ */
+class Metrics {
+private:
+	~Metrics();
+
+public:
+	enum class Counter {
+		Requests = 0,
+		Failures,
+		Timeouts,
+		Cancellations,
+		BytesRead,
+		BytesWritten,
+		Count
+	};
+
+	/// Cache consulted before running RetDec.
+	enum class CacheTier {
+		Memory = 0,
+		Disk,
+		Module,
+		Dedup,
+		Count
+	};
+
+public:
+	static void increment(Counter counter, uint64_t value = 1);
+	static void cacheLookup(CacheTier tier, bool hit);
+	static void observe(Stats::Phase phase, double milliseconds);
+	static void observeMemory(uint64_t bytes);
+
+	static std::string counterName(Counter counter);
+	static std::string tierName(CacheTier tier);
+
+	static std::string toJson();
+	static void reset();
+
+private:
+	static std::array<std::atomic<uint64_t>, size_t(Counter::Count)> _counters;
+	static std::array<std::atomic<uint64_t>, size_t(CacheTier::Count)> _hits;
+	static std::array<std::atomic<uint64_t>, size_t(CacheTier::Count)> _misses;
+	static std::atomic<uint64_t> _peakMemory;
+
+	static std::mutex _mutex;
+	static std::array<Histogram, size_t(Stats::Phase::Count)> _histograms;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2METRICS_H*/
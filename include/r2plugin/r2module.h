@@ -0,0 +1,115 @@
+/**
+ * @file include/r2plugin/r2module.h
+ * @brief Cache of optimized LLVM modules for backend-only decompilation.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2MODULE_H
+#define RETDEC_R2PLUGIN_R2MODULE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Keeps the optimized LLVM module of the last complete decompilation
+ * so that renames in Radare2 do not require the whole pipeline.
+ *
+ * Full pipeline saves the module right before retdec-llvmir2hll into
+ * rd_module.bc together with names of functions and global variables
+ * it was created with. Module is saved by whole-binary decompilation
+ * and by cached decompilations with output on the disk, or in memory
+ * output mode with $DEC_MODULE_CACHE set. Structural key of the config
+ * (config without names) is written only after the decompilation succeeds.
+ *
+ * When the structural key of a later request matches, the pipeline
+ * is replaced by provider initialization, load of the saved module,
+ * rename of its functions and global variables according to the new
+ * config and retdec-llvmir2hll.
+ *
+ * Module of whole-binary decompilation (pdzaa) is kept for the session
+ * under the structural key of r2 data after its functions were imported.
+ * Single-function requests with the same input, pipeline and structural
+ * key are then served from it by the same pipeline extended by
+ * retdec-select-fncs.
+ */
+class ModuleCache {
+private:
+	~ModuleCache();
+
+public:
+	static std::string structuralKey(const config::Config& config);
+	static std::string sessionKey(const config::Config& config);
+
+	static bool isEnabled(const config::Config& config, bool useCache);
+	static bool isWhole(const config::Config& config);
+
+	static bool prepareBackendOnly(config::Config& config, const std::string& key);
+	static bool prepareFromWhole(
+			config::Config& config,
+			const std::string& key,
+			const std::string& sessionKey);
+	static void prepareFull(config::Config& config, bool save);
+	static void commit(
+			const config::Config& config,
+			const std::string& key,
+			const std::string& sessionKey);
+	static void rekeyWhole(const std::string& sessionKey, const std::string& key);
+	static void invalidate(const config::Config& config);
+
+	static bool failed();
+
+	/// Called by the passes.
+	static const fs::path& loadPath();
+	static const fs::path& savePath();
+	static const std::vector<std::pair<std::string, std::string>>& renames();
+	static void fail();
+
+public:
+	static const std::string SavePass;
+	static const std::string LoadPass;
+	static const std::string RenamePass;
+
+protected:
+	static fs::path modulePath(const config::Config& config);
+	static fs::path keyPath(const config::Config& config);
+	static fs::path namesPath(const config::Config& config);
+
+	static std::map<std::string, std::string> namesByAddress(const config::Config& config);
+
+	static void useSavedModule(
+			config::Config& config,
+			const fs::path& module,
+			const std::map<std::string, std::string>& oldNames,
+			bool select);
+	static void reset();
+
+private:
+	/// Module of whole-binary decompilation.
+	struct WholeModule {
+		fs::path module;
+		std::map<std::string, std::string> names;
+		/// Structural key of the config the module was created with.
+		std::string key;
+	};
+
+	static fs::path _loadPath;
+	static fs::path _savePath;
+	static std::vector<std::pair<std::string, std::string>> _renames;
+	static std::map<std::string, std::string> _names;
+	static std::map<std::string, WholeModule> _wholeModules;
+	static bool _failed;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2MODULE_H*/
@@ -0,0 +1,81 @@
+/**
+ * @file include/r2plugin/r2passprof.h
+ * @brief Time and memory profile of LLVM passes of a decompilation.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2PASSPROF_H
+#define RETDEC_R2PLUGIN_R2PASSPROF_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Resources used by a single pass of the pipeline.
+ */
+struct PassSample {
+	std::string pass;
+	double milliseconds;
+	/// Change of resident memory of the process in bytes.
+	int64_t memory;
+	/// Growth of peak resident memory of the process in bytes.
+	uint64_t peakMemory;
+	/// Instructions in the module before and after the pass.
+	uint64_t instructionsBefore;
+	uint64_t instructionsAfter;
+};
+
+/**
+ * Records time, memory and size of IR of each LLVM pass of decompilations
+ * when $DEC_PASS_PROFILE is set.
+ *
+ * Profiling pass is inserted after each pass of the pipeline (and in front
+ * of the first one) and measures the pass in front of it. Checkpoints
+ * of the governor are accounted to the preceding pass. Profile is stored
+ * as rd_passes.tsv next to the cached result together with the key
+ * of the config, in memory output mode it is not stored. Samples are
+ * also written to the trace when $DEC_TRACE_FILE is set.
+ */
+class PassProfiler {
+private:
+	~PassProfiler();
+
+public:
+	static bool isEnabled();
+
+	static void instrument(config::Config& config);
+	static void sample(uint64_t instructions);
+
+	static fs::path path(const config::Config& config);
+	static void save(const fs::path& file, const std::string& key);
+	static std::vector<PassSample> load(const fs::path& file, const std::string& key);
+
+	static uint64_t peakResidentMemory();
+
+public:
+	/// Name of the LLVM pass that takes samples.
+	static const std::string ProfilePass;
+
+private:
+	static std::vector<std::string> _passes;
+	static std::vector<PassSample> _samples;
+	static size_t _next;
+	static std::chrono::steady_clock::time_point _last;
+	static uint64_t _lastMemory;
+	static uint64_t _lastPeakMemory;
+	static uint64_t _lastInstructions;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2PASSPROF_H*/
@@ -0,0 +1,59 @@
+/**
+ * @file include/r2plugin/r2profile.h
+ * @brief Decompilation pipeline profiles.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2PROFILE_H
+#define RETDEC_R2PLUGIN_R2PROFILE_H
+
+#include <string>
+#include <vector>
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Named set of overrides of RetDec's decompilation parameters.
+ *
+ * Profiles trade quality of the output for the speed of decompilation
+ * mostly by selecting LLVM passes that are run. Built-in profiles are
+ * fast, balanced and full (default). User can define further profiles
+ * in a JSON file specified by $DEC_PROFILES_FILE.
+ *
+ * Profile is selected per session by $DEC_PROFILE or per call
+ * as a parameter of pdz commands.
+ */
+class Profile {
+public:
+	Profile(const std::string& name, const std::string& help, const std::string& params);
+
+	const std::string& name() const;
+	const std::string& help() const;
+	bool isDefault() const;
+	std::string cacheName() const;
+
+	std::string apply(const std::string& configJson) const;
+
+	static Profile find(const std::string& name);
+	static Profile selected(const std::string& name = "");
+	static std::vector<Profile> available();
+
+public:
+	/// Name of the profile that does not change the default config.
+	static const std::string DefaultName;
+
+private:
+	static std::vector<Profile> parse(const std::string& json, const std::string& source);
+
+private:
+	std::string _name;
+	std::string _help;
+	/// Overrides of decompParams serialized as JSON object.
+	std::string _params;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2PROFILE_H*/
@@ -7,10 +7,14 @@
 #ifndef R2PLUGIN_R2RETDEC_H
 #define R2PLUGIN_R2RETDEC_H
 
+#include <ostream>
+
 #include <r_codemeta.h>
 #include <r_core.h>
 
 #include "r2plugin/r2data.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2index.h"
 #include "filesystem_wrapper.h"
 
 namespace retdec {
@@ -26,14 +30,39 @@ std::pair<RCodeMeta*, retdec::config::Config> decompile(
 
 std::pair<RCodeMeta*, retdec::config::Config> decompile(
 		config::Config& config,
-		bool useCache);
+		bool useCache,
+		CodeIndex* index = nullptr);
+
+std::pair<RCodeMeta*, retdec::config::Config> decompileFunction(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const std::string& profileName = "",
+		CodeIndex* index = nullptr,
+		bool* outOfBudget = nullptr);
 
-config::Config createConfig(const R2Database& binInfo, const std::string& cacheSuffix = "");
+config::Config createConfig(
+		const R2Database& binInfo,
+		const std::string& cacheSuffix = "",
+		const std::string& profileName = "");
+
+config::Config createFunctionConfig(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const std::string& profileName = "",
+		Budget* budget = nullptr);
 
 std::string cacheName(const common::Function& fnc);
 
+fs::path getBinaryDirName(const std::string& binaryPath);
+
+void constructHash(const config::Config& config, std::ostream& hash);
+
+fs::path getCachePath(const config::Config& config);
+
 fs::path getOutDirPath(const fs::path &suffix = "");
 
+bool hasInMemoryOutput(const config::Config& config);
+
 }
 }
 
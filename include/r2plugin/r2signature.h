@@ -0,0 +1,99 @@
+/**
+ * @file include/r2plugin/r2signature.h
+ * @brief Detection of statically linked library code.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2SIGNATURE_H
+#define RETDEC_R2PLUGIN_R2SIGNATURE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <retdec/config/config.h>
+
+#include "r2plugin/filesystem_wrapper.h"
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Library function known to the signature index.
+ */
+struct Signature {
+	std::string name;
+	/// Archive and its member the function was found in.
+	std::string library;
+	size_t size;
+};
+
+/**
+ * Index of functions from static libraries keyed by their normalized
+ * bytes.
+ *
+ * Index is built locally from static archives (.a) of relocatable ELF
+ * objects. Bytes of each global function are normalized the same way
+ * as functions of the analyzed binary (see R2Database::normalizeBytes),
+ * so identical library code matches regardless of where it was linked.
+ *
+ * Index is stored as a text file in $DEC_SIGNATURES (default
+ * rd_signatures.idx in the output directory) and is loaded once
+ * per session. Matched functions without a symbol or user given name
+ * are renamed in r2, which provides their types from its type database.
+ * All matched functions are excluded from bulk decompilation.
+ */
+class SignatureIndex {
+private:
+	~SignatureIndex();
+
+public:
+	/// Object function read from an archive.
+	struct ObjectFunction {
+		std::string name;
+		R2Address offset;
+		std::vector<uint8_t> bytes;
+	};
+
+public:
+	static fs::path path();
+
+	static size_t addArchive(const R2Database& binInfo, const fs::path& archive);
+
+	static const Signature* match(const R2Database& binInfo, const common::Function& fnc);
+	static std::map<R2Address, Signature> identify(const R2Database& binInfo);
+	static void exclude(
+			config::Config& config,
+			const std::map<R2Address, Signature>& matched);
+
+	static size_t size();
+
+protected:
+	static void load();
+	static void save();
+
+	static std::string archName(const R2Architecture& arch);
+
+	static std::vector<std::pair<std::string, std::vector<uint8_t>>> readArchive(
+			const fs::path& archive);
+	static std::vector<ObjectFunction> readObject(
+			const std::vector<uint8_t>& object,
+			const R2Architecture& arch);
+
+public:
+	/// Shorter functions are not indexed, they match too often.
+	static const size_t MinimumSize;
+
+private:
+	static fs::path _loadedPath;
+	/// Signatures keyed by architecture and hash of normalized bytes.
+	static std::map<std::pair<std::string, uint64_t>, Signature> _signatures;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2SIGNATURE_H*/
@@ -0,0 +1,94 @@
+/**
+ * @file include/r2plugin/r2stats.h
+ * @brief Latency of phases of decompilation requests.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2STATS_H
+#define RETDEC_R2PLUGIN_R2STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Collects time spent in each phase of decompilation requests
+ * for the whole session.
+ *
+ * Percentiles are computed from the most recent samples of each phase,
+ * count and maximum from all of them.
+ */
+class Stats {
+private:
+	~Stats();
+
+public:
+	/// Instrumented phase of a request.
+	enum class Phase {
+		Fetch = 0,
+		Config,
+		Hash,
+		CacheLookup,
+		RetDec,
+		JsonParse,
+		Annotations,
+		Total,
+		Count
+	};
+
+	/// Aggregates of a phase in milliseconds.
+	struct Summary {
+		uint64_t count;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	/**
+	 * Measures time of the phase for the lifetime of the object
+	 * or until stop is called.
+	 */
+	class Timer {
+	public:
+		Timer(Phase phase);
+		~Timer();
+
+		void stop();
+
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+	private:
+		Phase _phase;
+		std::chrono::steady_clock::time_point _start;
+		bool _running = true;
+	};
+
+public:
+	static void record(Phase phase, double milliseconds);
+	static Summary summary(Phase phase);
+	static std::string phaseName(Phase phase);
+
+	static std::string toJson();
+
+private:
+	/// Number of recent samples kept for percentiles of each phase.
+	static const size_t Window;
+
+	static std::mutex _mutex;
+	static std::array<std::deque<double>, size_t(Phase::Count)> _samples;
+	static std::array<uint64_t, size_t(Phase::Count)> _counts;
+	static std::array<double, size_t(Phase::Count)> _max;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2STATS_H*/
@@ -0,0 +1,85 @@
+/**
+ * @file include/r2plugin/r2trace.h
+ * @brief Export of decompilation sessions as Chrome trace events.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#ifndef RETDEC_R2PLUGIN_R2TRACE_H
+#define RETDEC_R2PLUGIN_R2TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "r2plugin/r2data.h"
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Writes spans of requests, their phases and LLVM passes into the trace
+ * file set in $DEC_TRACE_FILE in Chrome trace event format, which can be
+ * opened in chrome://tracing or Perfetto.
+ *
+ * Spans are complete events ("ph": "X") with process and thread of
+ * the code that produced them, so that interleaved requests, background
+ * jobs and workers are shown side by side. Function decompiled
+ * by the thread is attached to its spans as arguments. Each event
+ * is appended by a single write, so that events of forked workers
+ * sharing the file are never split.
+ */
+class Trace {
+private:
+	~Trace();
+
+public:
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * Sets function attached to spans of the current thread for
+	 * the lifetime of the object.
+	 */
+	class Context {
+	public:
+		Context(const std::string& function, R2Address address);
+		~Context();
+
+		Context(const Context&) = delete;
+		Context& operator=(const Context&) = delete;
+
+	private:
+		std::string _previousFunction;
+		R2Address _previousAddress;
+		bool _previousSet;
+	};
+
+public:
+	static bool isEnabled();
+
+	static void span(
+			const std::string& name,
+			const std::string& category,
+			Clock::time_point start,
+			Clock::time_point end,
+			const std::map<std::string, std::string>& args = {});
+
+private:
+	static bool open(const std::string& path);
+	static void write(const std::string& data);
+
+private:
+	static std::mutex _mutex;
+	static int _fd;
+	static std::string _path;
+
+	static thread_local std::string _function;
+	static thread_local R2Address _address;
+	static thread_local bool _hasContext;
+};
+
+}
+}
+
+#endif /*RETDEC_R2PLUGIN_R2TRACE_H*/
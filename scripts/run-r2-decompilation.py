@@ -2,7 +2,7 @@
 
 """The script decompiles the given file via RetDec R2 plugin.
 The supported decompilation modes are:
-   /TODO/ full      - decompile entire input file.
+   /TODO/ full      - decompile entire input file (r2retdec-batch does so natively).
    selective - decompile only the function selected by the given address.
 """
 
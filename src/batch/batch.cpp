@@ -0,0 +1,604 @@
+/**
+ * @file src/batch/batch.cpp
+ * @brief Headless batch decompilation of binaries with the r2plugin.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <retdec/utils/io/log.h>
+#include <r_core.h>
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2image.h"
+#include "r2plugin/r2journal.h"
+#include "r2plugin/r2retdec.h"
+#include "r2plugin/r2signature.h"
+
+using namespace retdec;
+using namespace retdec::r2plugin;
+using retdec::utils::io::Log;
+
+namespace {
+
+const char* Usage =
+	"Usage: r2retdec-batch [options] <binary>\n"
+	"\n"
+	"Decompiles functions of the binary into <name>@<address>.c and\n"
+	"<name>@<address>.json (code with annotations as printed by pdzj).\n"
+	"\n"
+	"Options:\n"
+	"  -o, --output <dir>      output directory (default: <binary>.retdec)\n"
+	"  -p, --project <name>    open r2 project instead of running the analysis\n"
+	"  -a, --analysis <cmds>   analysis commands (default: aaa)\n"
+	"  -c, --cmds <cmds>       r2 commands run after the analysis\n"
+	"  -s, --select <addr,...> decompile only functions containing the addresses\n"
+	"  -P, --profile <name>    decompilation profile (see pdzp)\n"
+	"  -j, --jobs <n>          number of worker processes (default: number of CPUs,\n"
+	"                          at most 4)\n"
+	"      --retry-failed      decompile again functions known to fail\n"
+	"      --restart           forget progress of previous runs\n"
+	"  -h, --help              show this help\n"
+	"\n"
+	"Progress is recorded in a journal next to the cache. Rerun resumes\n"
+	"where the previous one stopped and skips functions known to fail.\n"
+	"Without $DEC_SAVE_DIR the cache is kept in <output>/cache.\n";
+
+/// Upper bound of worker processes.
+const size_t MaxJobs = 256;
+
+/// Workers started by default. Each of them may need gigabytes
+/// of memory on large functions.
+const size_t DefaultMaxJobs = 4;
+
+struct Options {
+	std::string binary;
+	fs::path output;
+	std::string project;
+	std::string analysis = "aaa";
+	std::string commands;
+	std::vector<std::string> selected;
+	std::string profile;
+	bool restart = false;
+	bool retryFailed = false;
+	size_t jobs = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, DefaultMaxJobs);
+};
+
+/**
+ * Progress of the batch shared by the workers. Next function to
+ * decompile is taken by incrementing the counter. Each worker publishes
+ * function it is decompiling (index + 1, 0 when idle) so that the
+ * function is accounted for when the worker crashes.
+ */
+struct Progress {
+	std::atomic<uint64_t> next;
+	std::atomic<uint64_t> decompiled;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> current[MaxJobs];
+};
+
+void parseOptions(int argc, char** argv, Options& options)
+{
+	auto value = [&](int& i) -> std::string {
+		if (i+1 >= argc)
+			throw DecompilationError(std::string("missing value of ")+argv[i]);
+
+		return argv[++i];
+	};
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-h" || arg == "--help") {
+			std::cout << Usage;
+			std::exit(0);
+		}
+		else if (arg == "-o" || arg == "--output")
+			options.output = value(i);
+		else if (arg == "-p" || arg == "--project")
+			options.project = value(i);
+		else if (arg == "-a" || arg == "--analysis")
+			options.analysis = value(i);
+		else if (arg == "-c" || arg == "--cmds")
+			options.commands = value(i);
+		else if (arg == "-P" || arg == "--profile")
+			options.profile = value(i);
+		else if (arg == "--restart")
+			options.restart = true;
+		else if (arg == "--retry-failed")
+			options.retryFailed = true;
+		else if (arg == "-j" || arg == "--jobs")
+			options.jobs = std::stoul(value(i));
+		else if (arg == "-s" || arg == "--select") {
+			std::istringstream list(value(i));
+			std::string addr;
+			while (std::getline(list, addr, ','))
+				if (!addr.empty())
+					options.selected.push_back(addr);
+		}
+		else if (arg.size() > 1 && arg[0] == '-')
+			throw DecompilationError("unknown option: "+arg);
+		else if (options.binary.empty())
+			options.binary = arg;
+		else
+			throw DecompilationError("only one binary can be decompiled: "+arg);
+	}
+
+	if (options.binary.empty())
+		throw DecompilationError("no binary given");
+
+	if (options.output.empty())
+		options.output = options.binary + ".retdec";
+
+	options.jobs = std::clamp<size_t>(options.jobs, 1, MaxJobs);
+#if defined(_WIN32)
+	// Workers are forked processes.
+	options.jobs = 1;
+#endif
+}
+
+/**
+ * Name of the output files of the function without characters
+ * that are not allowed in file names.
+ */
+std::string outputName(const common::Function& fnc)
+{
+	auto name = cacheName(fnc);
+	std::replace_if(name.begin(), name.end(), [](char c) {
+		return std::strchr("/\\:*?\"<>|", c) != nullptr || c < 0x20;
+	}, '_');
+
+	return name;
+}
+
+const char* annotationType(RCodeMetaItemType type)
+{
+	switch (type) {
+	case R_CODEMETA_TYPE_OFFSET: return "offset";
+	case R_CODEMETA_TYPE_SYNTAX_HIGHLIGHT: return "syntax_highlight";
+	case R_CODEMETA_TYPE_FUNCTION_NAME: return "function_name";
+	case R_CODEMETA_TYPE_GLOBAL_VARIABLE: return "global_variable";
+	case R_CODEMETA_TYPE_CONSTANT_VARIABLE: return "constant_variable";
+	case R_CODEMETA_TYPE_LOCAL_VARIABLE: return "local_variable";
+	case R_CODEMETA_TYPE_FUNCTION_PARAMETER: return "function_parameter";
+	default: return "unknown";
+	}
+}
+
+const char* highlightType(RSyntaxHighlightType type)
+{
+	switch (type) {
+	case R_SYNTAX_HIGHLIGHT_TYPE_KEYWORD: return "keyword";
+	case R_SYNTAX_HIGHLIGHT_TYPE_COMMENT: return "comment";
+	case R_SYNTAX_HIGHLIGHT_TYPE_DATATYPE: return "datatype";
+	case R_SYNTAX_HIGHLIGHT_TYPE_FUNCTION_NAME: return "function_name";
+	case R_SYNTAX_HIGHLIGHT_TYPE_FUNCTION_PARAMETER: return "function_parameter";
+	case R_SYNTAX_HIGHLIGHT_TYPE_LOCAL_VARIABLE: return "local_variable";
+	case R_SYNTAX_HIGHLIGHT_TYPE_CONSTANT_VARIABLE: return "constant_variable";
+	case R_SYNTAX_HIGHLIGHT_TYPE_GLOBAL_VARIABLE: return "global_variable";
+	default: return "unknown";
+	}
+}
+
+/**
+ * Converts annotated code into JSON in the format of pdzj (r_codemeta_print_json),
+ * which prints to r2 console only.
+ */
+std::string annotationsJson(const RCodeMeta& code)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("code");
+	writer.String(code.code ? code.code : "");
+
+	writer.Key("annotations");
+	writer.StartArray();
+	auto annotations = static_cast<const RCodeMetaItem*>(code.annotations.a);
+	for (size_t i = 0; i < code.annotations.len; i++) {
+		const RCodeMetaItem *mi = &annotations[i];
+		writer.StartObject();
+		writer.Key("start");
+		writer.Uint64(mi->start);
+		writer.Key("end");
+		writer.Uint64(mi->end);
+		writer.Key("type");
+		writer.String(annotationType(mi->type));
+
+		switch (mi->type) {
+		case R_CODEMETA_TYPE_OFFSET:
+			writer.Key("offset");
+			writer.Uint64(mi->offset.offset);
+			break;
+		case R_CODEMETA_TYPE_SYNTAX_HIGHLIGHT:
+			writer.Key("syntax_highlight");
+			writer.String(highlightType(mi->syntax_highlight.type));
+			break;
+		case R_CODEMETA_TYPE_FUNCTION_NAME:
+		case R_CODEMETA_TYPE_GLOBAL_VARIABLE:
+		case R_CODEMETA_TYPE_CONSTANT_VARIABLE:
+			writer.Key("name");
+			writer.String(mi->reference.name ? mi->reference.name : "");
+			writer.Key("offset");
+			writer.Uint64(mi->reference.offset);
+			break;
+		case R_CODEMETA_TYPE_LOCAL_VARIABLE:
+		case R_CODEMETA_TYPE_FUNCTION_PARAMETER:
+			writer.Key("name");
+			writer.String(mi->variable.name ? mi->variable.name : "");
+			break;
+		default:
+			break;
+		}
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	return buffer.GetString();
+}
+
+void writeFile(const fs::path& path, const std::string& content)
+{
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file || !file.write(content.data(), content.size()))
+		throw DecompilationError("unable to write "+path.string());
+}
+
+/**
+ * Opens the binary (or project) and prepares it for decompilation.
+ */
+void prepare(RCore& core, const Options& options)
+{
+	r_config_set_i(core.config, "scr.interactive", 0);
+	if (!r_core_file_open(&core, options.binary.c_str(), R_PERM_RX, 0)
+			|| !r_core_bin_load(&core, options.binary.c_str(), UT64_MAX))
+		throw DecompilationError("unable to open "+options.binary);
+
+	if (!options.project.empty())
+		r_core_cmd0(&core, ("Po "+options.project).c_str());
+	else if (!options.analysis.empty())
+		r_core_cmd0(&core, options.analysis.c_str());
+
+	if (!options.commands.empty())
+		r_core_cmd0(&core, options.commands.c_str());
+}
+
+std::vector<common::Function> selectFunctions(const R2Database& binInfo, const Options& options)
+{
+	std::vector<common::Function> functions;
+
+	if (!options.selected.empty()) {
+		for (auto& addr: options.selected)
+			functions.push_back(binInfo.fetchFunction(r_num_math(binInfo.core().num, addr.c_str())));
+	}
+	else {
+		// Same selection as pdzab.
+		auto libraries = SignatureIndex::identify(binInfo);
+		for (auto& fnc: binInfo.fetchFunctions())
+			if (!libraries.count(fnc.getStart()))
+				functions.push_back(fnc);
+	}
+
+	std::sort(functions.begin(), functions.end(), [](auto& a, auto& b) {
+		return a.getStart() < b.getStart();
+	});
+	functions.erase(std::unique(functions.begin(), functions.end(), [](auto& a, auto& b) {
+		return a.getStart() == b.getStart();
+	}), functions.end());
+
+	return functions;
+}
+
+/**
+ * Writes output of the function. Description of the failure to fit
+ * the budget is not written.
+ */
+bool decompileTo(const R2Database& binInfo, const common::Function& fnc,
+		const Options& options, bool& outOfBudget)
+{
+	auto [code, _] = decompileFunction(binInfo, fnc, options.profile, nullptr, &outOfBudget);
+	if (code == nullptr)
+		return false;
+
+	std::unique_ptr<RCodeMeta, decltype(&r_codemeta_free)> guard(code, r_codemeta_free);
+	if (outOfBudget) {
+		Log::error() << Log::Error << fnc.getName() << ": decompilation did not fit its budget" << std::endl;
+		return false;
+	}
+
+	auto name = outputName(fnc);
+	writeFile(options.output/(name+".c"), code->code ? code->code : "");
+	writeFile(options.output/(name+".json"), annotationsJson(*code));
+	return true;
+}
+
+/**
+ * Functions to decompile with the state shared by workers.
+ */
+struct Batch {
+	const R2Database& binInfo;
+	const Options& options;
+	std::vector<common::Function> functions;
+	Journal journal;
+	Progress& progress;
+};
+
+/**
+ * Decompiles functions taken from the shared progress until there
+ * are none left. Reporter is given only to the worker in the process.
+ */
+void work(size_t worker, Batch& batch, ProgressReporter* reporter)
+{
+	auto& progress = batch.progress;
+
+	uint64_t i;
+	while ((i = progress.next.fetch_add(1)) < batch.functions.size()) {
+		auto& fnc = batch.functions[i];
+		progress.current[worker] = i+1;
+
+		auto start = std::chrono::steady_clock::now();
+		batch.journal.start(fnc);
+
+		bool decompiled = false;
+		bool outOfBudget = false;
+		try {
+			decompiled = decompileTo(batch.binInfo, fnc, batch.options, outOfBudget);
+		}
+		catch (const std::exception& err) {
+			Log::error() << Log::Error << fnc.getName() << ": " << err.what() << std::endl;
+		}
+
+		// Function out of budget is decompiled again by the next run,
+		// which may have larger budget.
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (outOfBudget)
+			batch.journal.abort(fnc, elapsed.count());
+		else
+			batch.journal.finish(fnc, decompiled, elapsed.count());
+
+		(decompiled ? progress.decompiled : progress.failed)++;
+		progress.current[worker] = 0;
+
+		if (reporter != nullptr)
+			reporter->update(progress.decompiled + progress.failed, progress.failed);
+	}
+}
+
+#if !defined(_WIN32)
+pid_t spawn(size_t worker, Batch& batch)
+{
+	pid_t parent = getpid();
+	pid_t pid = fork();
+	if (pid < 0)
+		throw DecompilationError("unable to start a worker: "+std::string(strerror(errno)));
+
+	if (pid == 0) {
+#if defined(__linux__)
+		// Worker must not outlive the batch when it is killed.
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		if (getppid() != parent)
+			_exit(1);
+
+		// Worker decompiles in its copy of the analyzed r2 core.
+		work(worker, batch, nullptr);
+		std::cout.flush();
+		std::cerr.flush();
+		_exit(0);
+	}
+
+	return pid;
+}
+
+/**
+ * Runs forked workers and reports their progress. Worker that crashed
+ * (typically on a function RetDec cannot handle) is replaced by a new
+ * one. Its start of the function stays in the journal as an unfinished
+ * attempt and the function is tried again after the others until it is
+ * known to fail.
+ */
+void runWorkers(Batch& batch, ProgressReporter& reporter)
+{
+	auto& progress = batch.progress;
+
+	std::vector<common::Function> retries;
+	std::map<pid_t, size_t> workers;
+	for (size_t w = 0; w < std::min(batch.options.jobs, batch.functions.size()); w++)
+		workers[spawn(w, batch)] = w;
+
+	while (!workers.empty() || !retries.empty()) {
+		if (workers.empty()) {
+			// Forked workers see the functions and the journal as they are now.
+			batch.functions = std::move(retries);
+			retries.clear();
+			progress.next = 0;
+			for (size_t w = 0; w < std::min(batch.options.jobs, batch.functions.size()); w++)
+				workers[spawn(w, batch)] = w;
+		}
+
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, WNOHANG);
+		if (pid == 0) {
+			reporter.update(progress.decompiled + progress.failed, progress.failed);
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			continue;
+		}
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		auto it = workers.find(pid);
+		if (it == workers.end())
+			continue;
+
+		size_t worker = it->second;
+		workers.erase(it);
+
+		if (auto current = progress.current[worker].exchange(0)) {
+			auto& fnc = batch.functions[current-1];
+			Log::error() << Log::Error << fnc.getName() << ": worker "
+				<< (WIFSIGNALED(status) ? "killed by signal "+std::to_string(WTERMSIG(status)) : "failed")
+				<< std::endl;
+
+			batch.journal.abandon(fnc);
+			if (batch.journal.isFailing(fnc.getStart()))
+				progress.failed++;
+			else
+				retries.push_back(fnc);
+
+			if (progress.next < batch.functions.size())
+				workers[spawn(worker, batch)] = worker;
+		}
+	}
+}
+
+Progress* createProgress()
+{
+	void* shared = mmap(nullptr, sizeof(Progress), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		throw DecompilationError("unable to share progress with workers");
+
+	return new (shared) Progress();
+}
+#else
+Progress* createProgress()
+{
+	return new Progress();
+}
+#endif
+
+/**
+ * Leaves out functions completed by the previous run (their output
+ * is present) and functions known to fail.
+ */
+std::vector<common::Function> pending(const std::vector<common::Function>& functions,
+		const Journal& journal, const Options& options)
+{
+	std::vector<common::Function> result;
+	for (auto& fnc: functions) {
+		auto name = outputName(fnc);
+		if (journal.isDone(fnc.getStart())
+				&& fs::is_regular_file(options.output/(name+".c"))
+				&& fs::is_regular_file(options.output/(name+".json")))
+			continue;
+
+		if (!options.retryFailed && journal.isFailing(fnc.getStart()))
+			continue;
+
+		result.push_back(fnc);
+	}
+
+	return result;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+
+	try {
+		parseOptions(argc, argv, options);
+	}
+	catch (const std::exception& err) {
+		Log::error() << Log::Error << err.what() << std::endl;
+		std::cerr << Usage;
+		return 1;
+	}
+
+	try {
+		std::error_code err;
+		fs::create_directories(options.output, err);
+		if (!fs::is_directory(options.output))
+			throw DecompilationError("unable to create output directory "+options.output.string());
+
+		if (Environment::get("DEC_SAVE_DIR").empty()) {
+			fs::create_directories(options.output/"cache", err);
+			Environment::set("DEC_SAVE_DIR", (options.output/"cache").string());
+		}
+
+		RCore* core = r_core_new();
+		if (core == nullptr)
+			throw DecompilationError("unable to create r2 core");
+
+		std::unique_ptr<RCore, decltype(&r_core_free)> guard(core, r_core_free);
+		prepare(*core, options);
+
+		R2Database binInfo(*core);
+
+		// Journal is kept next to the cache of the binary.
+		auto binaryDir = getOutDirPath(getBinaryDirName(binInfo.fetchFilePath()));
+		auto journal = Journal::open(
+			Journal::path(binaryDir, options.profile.empty() ? "batch" : "batch-"+options.profile),
+			InputImage::checksum(binInfo.fetchFilePath()));
+		if (options.restart)
+			journal.clear();
+
+		auto functions = selectFunctions(binInfo, options);
+		auto todo = pending(functions, journal, options);
+		auto skipped = functions.size() - todo.size();
+
+		if (todo.size() != functions.size())
+			Log::info() << "resuming: " << functions.size() - todo.size() << " of "
+				<< functions.size() << " functions done or known to fail" << std::endl;
+
+		Log::info() << "decompiling " << todo.size() << " functions of "
+			<< options.binary << " with " << options.jobs << " worker(s)" << std::endl;
+
+		Progress* progress = createProgress();
+		progress->next = 0;
+		progress->decompiled = 0;
+		progress->failed = 0;
+		for (auto& current: progress->current)
+			current = 0;
+
+		Batch batch{binInfo, options, std::move(todo), std::move(journal), *progress};
+		ProgressReporter reporter(batch.functions.size());
+
+#if !defined(_WIN32)
+		if (options.jobs > 1)
+			runWorkers(batch, reporter);
+		else
+#endif
+			work(0, batch, &reporter);
+
+		Log::info() << "decompiled: " << progress->decompiled
+			<< ", failed: " << progress->failed
+			<< ", skipped: " << skipped
+			<< ", output: " << options.output.string() << std::endl;
+
+		return progress->failed == 0 ? 0 : 2;
+	}
+	catch (const std::exception& err) {
+		Log::error() << Log::Error << err.what() << std::endl;
+		return 1;
+	}
+}
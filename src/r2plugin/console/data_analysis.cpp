@@ -4,12 +4,25 @@
  * @copyright (c) 2020 Avast Software, licensed under the MIT license.
  */
 
+#include <chrono>
 #include <iostream>
 #include <regex>
+#include <sstream>
 
+#include <retdec/utils/io/log.h>
+
+#include "r2plugin/r2dedup.h"
+#include "r2plugin/r2diff.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2image.h"
+#include "r2plugin/r2journal.h"
+#include "r2plugin/r2module.h"
 #include "r2plugin/r2retdec.h"
+#include "r2plugin/r2signature.h"
 #include "r2plugin/console/data_analysis.h"
 
+using namespace retdec::utils::io;
+
 namespace retdec {
 namespace r2plugin {
 
@@ -28,12 +41,23 @@ Console::Command DataAnalysisConsole::AnalyzeWholeBinary{
 	analyzeWholeBinary
 };
 
+Console::Command DataAnalysisConsole::DecompileAllFunctions{
+	"Decompile each function known to r2 separately. "
+	"Functions with identical bytes are decompiled once with DEC_DEDUP=1, "
+	"library functions matched by pdzl signatures are skipped. "
+	"Interrupted run is resumed, pdzab- (or pdzab -) starts over.",
+	decompileAllFunctions,
+	false,
+	"[-] [profile]"
+};
+
 DataAnalysisConsole::DataAnalysisConsole(): Console(
 	"pdza",
 	"Run RetDec analysis.",
 	{
 		{"", AnalyzeRange},
-		{"a", AnalyzeWholeBinary}
+		{"a", AnalyzeWholeBinary},
+		{"b", DecompileAllFunctions}
 	})
 {
 }
@@ -120,7 +144,10 @@ bool DataAnalysisConsole::analyzeRange(const std::string& command, const R2Datab
 
 bool DataAnalysisConsole::analyzeWholeBinary(const std::string&, const R2Database& binInfo)
 {
+	auto libraries = SignatureIndex::identify(binInfo);
+
 	auto config = createConfig(binInfo, "whole");
+	SignatureIndex::exclude(config, libraries);
 
 	auto [code, _] = decompile(config, false);
 	if (code == nullptr)
@@ -129,6 +156,138 @@ bool DataAnalysisConsole::analyzeWholeBinary(const std::string&, const R2Databas
 	// r_core_annotated_code_print(code, nullptr);
 	binInfo.setFunctions(config);
 
+	// Single functions are emitted from the module of this decompilation
+	// while r2 data stay as it left them.
+	auto current = createConfig(binInfo, "whole");
+	binInfo.fetchFunctionsAndGlobals(current);
+	ModuleCache::rekeyWhole(ModuleCache::sessionKey(current), ModuleCache::structuralKey(current));
+
+	return true;
+}
+
+/**
+ * Decompiles functions one by one, storing results in the cache so that
+ * subsequent pdz commands are served immediately.
+ *
+ * Progress is recorded in the journal, so that interrupted run resumes
+ * where it stopped and functions known to fail are not decompiled again.
+ * Results of completed functions are taken from the manifest of the previous
+ * run. pdzab- (or pdzab -) starts over.
+ */
+bool DataAnalysisConsole::decompileAllFunctions(const std::string& command, const R2Database& binInfo)
+{
+	bool restart = command.compare(0, 6, "pdzab-") == 0;
+
+	std::string profile;
+	std::istringstream args(command);
+	std::string arg;
+	args >> arg;
+	while (args >> arg) {
+		if (arg == "-" && profile.empty())
+			restart = true;
+		else
+			profile = arg;
+	}
+
+	auto binaryDir = getOutDirPath(getBinaryDirName(binInfo.fetchFilePath()));
+	auto journal = Journal::open(
+		Journal::path(binaryDir, profile.empty() ? "pdzab" : "pdzab-"+profile),
+		InputImage::checksum(binInfo.fetchFilePath()));
+	if (restart)
+		journal.clear();
+
+	size_t decompiled = 0, failed = 0, resumed = 0, skipped = 0;
+	auto hits = DedupStore::hits();
+	auto libraries = SignatureIndex::identify(binInfo);
+	Manifest manifest;
+	manifest.setProfile(profile);
+
+	auto manifestPath = Manifest::path(binaryDir);
+	auto previous = journal.done() != 0 && fs::is_regular_file(manifestPath)
+		? Manifest::load(manifestPath)
+		: Manifest();
+
+	std::vector<common::Function> functions;
+	for (auto& fnc: binInfo.fetchFunctions()) {
+		if (!libraries.count(fnc.getStart()))
+			functions.push_back(fnc);
+	}
+
+	auto pending = std::count_if(functions.begin(), functions.end(), [&](auto& fnc) {
+		return !journal.isDone(fnc.getStart()) && !journal.isFailing(fnc.getStart());
+	});
+	if (size_t(pending) != functions.size())
+		Log::info() << "resuming: " << functions.size() - pending << " of "
+			<< functions.size() << " functions done or known to fail" << std::endl;
+
+	// Cancellation of a request before this run does not stop it.
+	Governor::forgetCancellation();
+
+	ProgressReporter progress(pending);
+	for (auto& fnc: functions) {
+		if (Governor::isCancelled())
+			break;
+
+		manifest.add(Manifest::describe(binInfo, fnc));
+
+		// Result of a completed function is taken from the cache when it is still there.
+		if (journal.isDone(fnc.getStart())) {
+			if (manifest.resume(fnc.getStart(), previous)) {
+				resumed++;
+				continue;
+			}
+		}
+		else if (journal.isFailing(fnc.getStart())) {
+			skipped++;
+			continue;
+		}
+
+		progress.update(decompiled + failed, failed);
+
+		auto start = std::chrono::steady_clock::now();
+		journal.start(fnc);
+		bool outOfBudget = false;
+		auto [code, config] = decompileFunction(binInfo, fnc, profile, nullptr, &outOfBudget);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		// Cancelled function is not known to fail.
+		if (code == nullptr && Governor::isCancelled()) {
+			journal.abort(fnc, elapsed.count());
+			break;
+		}
+
+		// Function out of budget is decompiled again by the next run,
+		// which may have larger budget.
+		if (outOfBudget) {
+			r_codemeta_free(code);
+			journal.abort(fnc, elapsed.count());
+			failed++;
+			continue;
+		}
+
+		journal.finish(fnc, code != nullptr, elapsed.count());
+		if (code == nullptr) {
+			failed++;
+			continue;
+		}
+
+		r_codemeta_free(code);
+		manifest.record(binInfo, fnc.getStart(), config);
+		decompiled++;
+	}
+
+	// Manifest allows to carry results forward to the next build (pdzd).
+	// Run stopped before any function does not replace the previous one.
+	if (decompiled + failed + resumed + skipped != 0)
+		manifest.save(manifestPath);
+
+	Log::info() << "decompiled: " << decompiled
+		<< ", deduplicated: " << DedupStore::hits() - hits
+		<< ", library: " << libraries.size()
+		<< ", resumed: " << resumed
+		<< ", known to fail: " << skipped
+		<< ", failed: " << failed << std::endl;
+
 	return true;
 }
 
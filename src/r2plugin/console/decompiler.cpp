@@ -4,10 +4,22 @@
  * @copyright (c) 2020 avast software, licensed under the mit license.
  */
 
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
 #include <retdec/utils/io/log.h>
 
 #include "r2plugin/console/decompiler.h"
 #include "r2plugin/console/data_analysis.h"
+#include "r2plugin/r2cost.h"
+#include "r2plugin/r2diff.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2metrics.h"
+#include "r2plugin/r2passprof.h"
+#include "r2plugin/r2profile.h"
+#include "r2plugin/r2signature.h"
+#include "r2plugin/r2stats.h"
 
 #define CMD_PREFIX "pdz" /**< Plugin activation command in r2 console.**/
 
@@ -25,31 +37,48 @@ DecompilerConsole::DecompilerConsole(): Console(
 		{"", DecompileCurrent},
 		{"*", DecompileCommentCurrent},
 		{"a", DecompilerDataAnalysis},
+		{"b", ShowBudgetStatistics},
+		{"c", CancelRunning},
+		{"d", DiffPrevious},
 		{"e", ShowUsedEnvironment},
+		{"i", QueryIndexCurrent},
 		{"j", DecompileJsonCurrent},
-		{"o", DecompileWithOffsetsCurrent}
+		{"l", LibrarySignatures},
+		{"m", ShowMetrics},
+		{"o", DecompileWithOffsetsCurrent},
+		{"p", ShowProfiles},
+		{"r", ShowPassProfile},
+		{"s", ShowPhaseStatistics}
 	})
 {
 }
 
 const Console::Command DecompilerConsole::DecompileCurrent = {
 	"Show decompilation result of current function.",
-	DecompilerConsole::decompileCurrent
+	DecompilerConsole::decompileCurrent,
+	false,
+	"[profile]"
 };
 
 const Console::Command DecompilerConsole::DecompileWithOffsetsCurrent = {
 	"Show current decompiled function side by side with offsets.",
-	DecompilerConsole::decompileWithOffsetsCurrent
+	DecompilerConsole::decompileWithOffsetsCurrent,
+	false,
+	"[profile]"
 };
 
 const Console::Command DecompilerConsole::DecompileJsonCurrent = {
 	"Dump current decompiled function as JSON.",
-	DecompilerConsole::decompileJsonCurrent
+	DecompilerConsole::decompileJsonCurrent,
+	false,
+	"[profile]"
 };
 
 const Console::Command DecompilerConsole::DecompileCommentCurrent = {
 	"Return decompilation of current function to r2 as comment.",
-	DecompilerConsole::decompileCommentCurrent
+	DecompilerConsole::decompileCommentCurrent,
+	false,
+	"[profile]"
 };
 
 const Console::Command DecompilerConsole::DecompilerDataAnalysis = {
@@ -58,21 +87,88 @@ const Console::Command DecompilerConsole::DecompilerDataAnalysis = {
 	true
 };
 
+const Console::Command DecompilerConsole::QueryIndexCurrent = {
+	"Show lines of current decompiled function that belong to the address.",
+	DecompilerConsole::queryIndexCurrent,
+	false,
+	"[addr]"
+};
+
 const Console::Command DecompilerConsole::ShowUsedEnvironment = {
-	"Show environment variables.",
-	DecompilerConsole::showEnvironment
+	"Show environment variables or set one for the session.",
+	DecompilerConsole::showEnvironment,
+	false,
+	"[VAR=value]"
 };
 
-config::Config DecompilerConsole::createConsoleConfig(const R2Database& binInfo)
-{
-	auto fnc = binInfo.fetchSeekedFunction();
-	auto config = createConfig(binInfo, cacheName(fnc));
-	config.parameters.selectedRanges.insert(fnc);
-	config.parameters.setIsSelectedDecodeOnly(true);
+const Console::Command DecompilerConsole::ShowProfiles = {
+	"List pipeline profiles. Selected profile is marked with *.",
+	DecompilerConsole::showProfiles
+};
+
+const Console::Command DecompilerConsole::ShowBudgetStatistics = {
+	"Show budgets of the session and how often each pipeline tier finished decompilation.",
+	DecompilerConsole::showBudgetStatistics
+};
+
+const Console::Command DecompilerConsole::ShowPhaseStatistics = {
+	"Show latency of phases of decompilation requests in this session (count, p50, p95, p99, max).",
+	DecompilerConsole::showPhaseStatistics,
+	false,
+	"[j]"
+};
+
+const Console::Command DecompilerConsole::ShowPassProfile = {
+	"Show time, memory and IR size of LLVM passes of current function sorted by time "
+	"(recorded with DEC_PASS_PROFILE=1).",
+	DecompilerConsole::showPassProfile,
+	false,
+	"[profile]"
+};
+
+const Console::Command DecompilerConsole::ShowMetrics = {
+	"Dump counters and latency histograms of the session as JSON. Reset them with pdzm-.",
+	DecompilerConsole::showMetrics,
+	false,
+	"[-]"
+};
+
+const Console::Command DecompilerConsole::CancelRunning = {
+	"Cancel running decompilation (e.g. from another r2pipe or web client).",
+	DecompilerConsole::cancelRunning
+};
 
-	binInfo.fetchFunctionsAndGlobals(config);
+const Console::Command DecompilerConsole::DiffPrevious = {
+	"Decompile only functions new or changed since the previous build "
+	"processed by pdzab and carry results of identical ones forward.",
+	DecompilerConsole::diffPrevious,
+	false,
+	"<previous binary|dir>"
+};
 
-	return config;
+const Console::Command DecompilerConsole::LibrarySignatures = {
+	"Add functions of static archives to the signature index or, without arguments, "
+	"name functions of the binary that match it.",
+	DecompilerConsole::librarySignatures,
+	false,
+	"[archive.a ...]"
+};
+
+/**
+ * Decompiles the seeked function. Optional parameter of the command
+ * selects the profile.
+ */
+std::pair<RCodeMeta*, config::Config> DecompilerConsole::decompileSeeked(
+		const R2Database& binInfo,
+		const std::string& command,
+		CodeIndex* index)
+{
+	std::string profile;
+	auto space = std::find(command.begin(), command.end(), ' ');
+	if (space != command.end())
+		profile = std::string(std::next(space), command.end());
+
+	return decompileFunction(binInfo, binInfo.fetchSeekedFunction(), profile, index);
 }
 
 bool DecompilerConsole::handleCommand(const std::string& command, const R2Database& info)
@@ -80,11 +176,9 @@ bool DecompilerConsole::handleCommand(const std::string& command, const R2Databa
 	return DecompilerConsole::console.handle(command, info);
 }
 
-bool DecompilerConsole::decompileCurrent(const std::string&, const R2Database& binInfo)
+bool DecompilerConsole::decompileCurrent(const std::string& command, const R2Database& binInfo)
 {
-	auto config = createConsoleConfig(binInfo);
-
-	auto [code, _] = decompile(config, true);
+	auto [code, _] = decompileSeeked(binInfo, command);
 	if (code == nullptr)
 		return false;
 
@@ -92,39 +186,63 @@ bool DecompilerConsole::decompileCurrent(const std::string&, const R2Database& b
 	return true;
 }
 
-bool DecompilerConsole::decompileWithOffsetsCurrent(const std::string&, const R2Database& binInfo)
+bool DecompilerConsole::decompileWithOffsetsCurrent(const std::string& command, const R2Database& binInfo)
 {
-	auto config = createConsoleConfig(binInfo);
-
-	auto [code, _] = decompile(config, true);
+	CodeIndex index;
+	auto [code, _] = decompileSeeked(binInfo, command, &index);
 	if (code == nullptr)
 		return false;
 
-	RVector *offsets = r_codemeta_line_offsets(code);
+	RVector *offsets = index.lineOffsets();
 	r_codemeta_print(code, offsets);
 	r_vector_free(offsets);
 
 	return true;
 }
 
-
-bool DecompilerConsole::decompileJsonCurrent(const std::string&, const R2Database& binInfo)
+bool DecompilerConsole::queryIndexCurrent(const std::string& command, const R2Database& binInfo)
 {
-	auto config = createConsoleConfig(binInfo);
+	ut64 address = binInfo.seekedAddress();
+	auto space = std::find(command.begin(), command.end(), ' ');
+	if (space != command.end()) {
+		std::string param(std::next(space), command.end());
+		address = r_num_math(binInfo.core().num, param.c_str());
+	}
 
-	auto [code, _] = decompile(config, true);
+	CodeIndex index;
+	auto [code, _] = decompileSeeked(binInfo, "", &index);
 	if (code == nullptr)
 		return false;
 
-	r_codemeta_print_json(code);
+	std::string text(code->code);
+	r_codemeta_free(code);
+
+	for (auto line: index.linesOf(address)) {
+		auto begin = index.lines()[line].start;
+		auto end = text.find('\n', begin);
+		if (end != std::string::npos)
+			end -= begin;
+
+		Log::info() << line << "\t" << text.substr(begin, end) << std::endl;
+	}
+
 	return true;
 }
 
-bool DecompilerConsole::decompileCommentCurrent(const std::string&, const R2Database& binInfo)
+
+bool DecompilerConsole::decompileJsonCurrent(const std::string& command, const R2Database& binInfo)
 {
-	auto config = createConsoleConfig(binInfo);
+	auto [code, _] = decompileSeeked(binInfo, command);
+	if (code == nullptr)
+		return false;
+
+	r_codemeta_print_json(code);
+	return true;
+}
 
-	auto [code, _] = decompile(config, true);
+bool DecompilerConsole::decompileCommentCurrent(const std::string& command, const R2Database& binInfo)
+{
+	auto [code, _] = decompileSeeked(binInfo, command);
 	if (code == nullptr)
 		return false;
 
@@ -132,20 +250,279 @@ bool DecompilerConsole::decompileCommentCurrent(const std::string&, const R2Data
 	return true;
 }
 
-bool DecompilerConsole::showEnvironment(const std::string&, const R2Database&)
+bool DecompilerConsole::showEnvironment(const std::string& command, const R2Database&)
 {
+	auto space = std::find(command.begin(), command.end(), ' ');
+	if (space != command.end()) {
+		std::string param(std::next(space), command.end());
+		auto eq = param.find('=');
+		if (eq == std::string::npos)
+			throw DecompilationError("expected VAR=value: "+param);
+
+		Environment::set(param.substr(0, eq), param.substr(eq+1));
+		return true;
+	}
+
 	Log::info() << Log::Color::Green << "Environment:" << std::endl;
 
 	std::string padding = "    ";
 
-	std::string outDir;
-	try {
-		outDir = getOutDirPath("").string();
-	} catch(const DecompilationError &e) {
-		outDir = e.what();
+	for (auto& var: Environment::variables()) {
+		std::string value;
+		try {
+			value = var.name == "DEC_SAVE_DIR"
+				? getOutDirPath("").string()
+				: Environment::get(var.name);
+		} catch(const DecompilationError &e) {
+			value = e.what();
+		}
+
+		Log::info() << padding << var.name << " = " << value
+			<< " # " << var.help << std::endl;
+	}
+
+	return true;
+}
+
+bool DecompilerConsole::showProfiles(const std::string&, const R2Database&)
+{
+	auto selected = Environment::get("DEC_PROFILE");
+
+	Log::info() << Log::Color::Green << "Profiles:" << std::endl;
+
+	for (auto& profile: Profile::available()) {
+		std::string mark = profile.name() == selected ? "  * " : "    ";
+		Log::info() << mark << profile.name() << " # " << profile.help() << std::endl;
+	}
+
+	std::string mark = selected == CostModel::ProfileName ? "  * " : "    ";
+	Log::info() << mark << CostModel::ProfileName
+		<< " # selected per function by the cost model (calibration "
+		<< CostModel::calibration() << ")" << std::endl;
+
+	return true;
+}
+
+bool DecompilerConsole::showBudgetStatistics(const std::string&, const R2Database&)
+{
+	auto budget = Budget::session();
+	auto stats = Governor::statistics();
+
+	auto limit = [](uint64_t value, const std::string& unit) {
+		return value == 0 ? std::string("unlimited") : std::to_string(value)+" "+unit;
+	};
+
+	Log::info() << Log::Color::Green << "Budget:" << std::endl;
+	Log::info() << "    time   = " << limit(budget.milliseconds, "ms") << std::endl;
+	Log::info() << "    memory = " << limit(budget.memory >> 20, "MB") << std::endl;
+
+	Log::info() << Log::Color::Green << "Finished by:" << std::endl;
+	Log::info() << "    requested profile = " << stats[0] << std::endl;
+	Log::info() << "    " << Governor::FallbackProfile << " profile  = " << stats[1] << std::endl;
+	Log::info() << "    partial failure   = " << stats[2] << std::endl;
+
+	return true;
+}
+
+/**
+ * Shows latency of phases in milliseconds. With j argument (pdzs j, pdzsj)
+ * the statistics are dumped as JSON.
+ */
+bool DecompilerConsole::showPhaseStatistics(const std::string& command, const R2Database&)
+{
+	auto arg = command.substr(std::min<size_t>(command.size(), 4));
+	arg.erase(std::remove(arg.begin(), arg.end(), ' '), arg.end());
+
+	if (arg == "j") {
+		r_cons_println(Stats::toJson().c_str());
+		return true;
+	}
+
+	auto column = [](const std::string& value, size_t width) {
+		return std::string(width > value.size() ? width - value.size() : 0, ' ') + value;
+	};
+
+	auto number = [](double ms) {
+		std::ostringstream str;
+		str << std::fixed << std::setprecision(1) << ms;
+		return str.str();
+	};
+
+	Log::info() << Log::Color::Green << "Phases (ms):" << std::endl;
+	Log::info() << "    " << std::left << std::setw(14) << "phase" << std::right
+		<< column("count", 8) << column("p50", 10) << column("p95", 10)
+		<< column("p99", 10) << column("max", 10) << std::endl;
+
+	for (size_t i = 0; i < size_t(Stats::Phase::Count); i++) {
+		auto phase = Stats::Phase(i);
+		auto stats = Stats::summary(phase);
+
+		Log::info() << "    " << std::left << std::setw(14) << Stats::phaseName(phase) << std::right
+			<< column(std::to_string(stats.count), 8)
+			<< column(number(stats.p50), 10) << column(number(stats.p95), 10)
+			<< column(number(stats.p99), 10) << column(number(stats.max), 10) << std::endl;
 	}
 
-	Log::info() << padding << "DEC_SAVE_DIR = " << outDir << std::endl;
+	return true;
+}
+
+bool DecompilerConsole::showMetrics(const std::string& command, const R2Database&)
+{
+	auto arg = command.substr(std::min<size_t>(command.size(), 4));
+	arg.erase(std::remove(arg.begin(), arg.end(), ' '), arg.end());
+
+	if (arg == "-") {
+		Metrics::reset();
+		return true;
+	}
+
+	r_cons_println(Metrics::toJson().c_str());
+	return true;
+}
+
+/**
+ * Shows profile of passes stored with the cached result of the seeked
+ * function. Optional parameter selects the profile of the pipeline.
+ */
+bool DecompilerConsole::showPassProfile(const std::string& command, const R2Database& binInfo)
+{
+	std::string profile;
+	auto space = std::find(command.begin(), command.end(), ' ');
+	if (space != command.end())
+		profile = std::string(std::next(space), command.end());
+
+	auto config = createFunctionConfig(binInfo, binInfo.fetchSeekedFunction(), profile);
+
+	std::ostringstream hash;
+	constructHash(config, hash);
+
+	auto samples = PassProfiler::load(PassProfiler::path(config), hash.str());
+	if (samples.empty()) {
+		Log::error() << "no profile of passes, set DEC_PASS_PROFILE=1 and run pdz" << std::endl;
+		return false;
+	}
+
+	std::sort(samples.begin(), samples.end(),
+		[](const PassSample& a, const PassSample& b) {
+			return a.milliseconds > b.milliseconds;
+		});
+
+	double total = 0;
+	for (auto& sample: samples)
+		total += sample.milliseconds;
+
+	auto megabytes = [](double bytes) {
+		std::ostringstream str;
+		str << std::fixed << std::setprecision(1) << bytes/(1 << 20);
+		return str.str();
+	};
+
+	Log::info() << Log::Color::Green << "Passes (" << std::fixed << std::setprecision(1)
+		<< total << " ms):" << std::endl;
+	Log::info() << "    " << std::left << std::setw(36) << "pass" << std::right
+		<< std::setw(10) << "ms" << std::setw(7) << "%"
+		<< std::setw(10) << "rss MB" << std::setw(10) << "peak MB"
+		<< std::setw(22) << "instructions" << std::endl;
+
+	for (auto& sample: samples) {
+		std::ostringstream instructions;
+		instructions << sample.instructionsBefore << " -> " << sample.instructionsAfter;
+
+		Log::info() << "    " << std::left << std::setw(36) << sample.pass << std::right
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(10) << sample.milliseconds
+			<< std::setw(7) << (total > 0 ? 100*sample.milliseconds/total : 0)
+			<< std::setw(10) << megabytes(sample.memory)
+			<< std::setw(10) << megabytes(sample.peakMemory)
+			<< std::setw(22) << instructions.str() << std::endl;
+	}
+
+	return true;
+}
+
+bool DecompilerConsole::cancelRunning(const std::string&, const R2Database&)
+{
+	Governor::cancel();
+	return true;
+}
+
+/**
+ * Diffs the binary with its previous build given by its path (as it was
+ * opened in r2) or by its directory in the output directory.
+ */
+bool DecompilerConsole::diffPrevious(const std::string& command, const R2Database& binInfo)
+{
+	auto space = std::find(command.begin(), command.end(), ' ');
+	if (space == command.end()) {
+		Log::error() << "missing previous build of the binary" << std::endl;
+		return false;
+	}
+
+	fs::path previous = std::string(std::next(space), command.end());
+	if (!fs::is_regular_file(Manifest::path(previous)))
+		previous = getOutDirPath()/getBinaryDirName(previous.string());
+
+	auto changes = BinaryDiff::update(binInfo, previous);
+
+	std::map<FunctionChange::Kind, size_t> counts;
+	for (auto& change: changes) {
+		counts[change.kind]++;
+		if (change.kind == FunctionChange::Kind::Identical)
+			continue;
+
+		auto& entry = change.kind == FunctionChange::Kind::Removed ? change.previous : change.current;
+		Log::info() << BinaryDiff::kindName(change.kind) << "\t0x" << std::hex
+			<< entry.function.getStart().getValue() << std::dec << "\t" << entry.function.getName();
+
+		if (change.kind == FunctionChange::Kind::Changed) {
+			Log::info() << "\t(was 0x" << std::hex << change.previous.function.getStart().getValue()
+				<< std::dec << " " << change.previous.function.getName() << ")";
+		}
+
+		Log::info() << std::endl;
+	}
+
+	Log::info() << Log::Color::Green << "identical: " << counts[FunctionChange::Kind::Identical]
+		<< ", changed: " << counts[FunctionChange::Kind::Changed]
+		<< ", added: " << counts[FunctionChange::Kind::Added]
+		<< ", removed: " << counts[FunctionChange::Kind::Removed] << std::endl;
+
+	return true;
+}
+
+/**
+ * Builds the signature index from archives given as arguments
+ * or identifies library functions in the binary.
+ */
+bool DecompilerConsole::librarySignatures(const std::string& command, const R2Database& binInfo)
+{
+	std::vector<std::string> archives;
+	std::istringstream params(command);
+	std::string archive;
+	params >> archive;
+	while (params >> archive)
+		archives.push_back(archive);
+
+	if (!archives.empty()) {
+		for (auto& path: archives) {
+			auto added = SignatureIndex::addArchive(binInfo, path);
+			Log::info() << path << ": " << added << " functions added" << std::endl;
+		}
+
+		Log::info() << SignatureIndex::path().string() << ": "
+			<< SignatureIndex::size() << " signatures" << std::endl;
+		return true;
+	}
+
+	auto matched = SignatureIndex::identify(binInfo);
+	for (auto& [addr, signature]: matched) {
+		Log::info() << "0x" << std::hex << addr << std::dec << "\t"
+			<< signature.name << "\t" << signature.library << std::endl;
+	}
+
+	Log::info() << Log::Color::Green << matched.size() << " library functions matched ("
+		<< SignatureIndex::size() << " signatures)" << std::endl;
+
 	return true;
 }
 
@@ -0,0 +1,184 @@
+/**
+ * @file src/r2plugin/profiles-config.h
+ * @brief Provides built-in decompilation pipeline profiles.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace retdec {
+namespace r2plugin {
+
+/**
+ * Profiles override parameters in decompParams of DefaultConfigJSON.
+ * User-defined profiles provided in $DEC_PROFILES_FILE use the same format.
+ */
+const std::string BuiltinProfilesJSON = R"(
+{
+    "profiles": {
+        "fast": {
+            "help": "interactive triage: single short optimization round, no crypto patterns",
+            "decompParams": {
+                "cryptoPatternPaths": [],
+                "llvmPasses" : [
+                    "retdec-provider-init",
+                    "retdec-decoder",
+                    "verify",
+                    "retdec-x86-addr-spaces",
+                    "retdec-x87-fpu",
+                    "retdec-main-detection",
+                    "retdec-idioms-libgcc",
+                    "retdec-inst-opt",
+                    "retdec-cond-branch-opt",
+                    "retdec-syscalls",
+                    "retdec-stack",
+                    "retdec-constants",
+                    "retdec-param-return",
+                    "retdec-inst-opt-rda",
+                    "retdec-inst-opt",
+                    "retdec-simple-types",
+                    "retdec-write-dsm",
+                    "retdec-remove-asm-instrs",
+                    "retdec-select-fncs",
+                    "retdec-unreachable-funcs",
+                    "retdec-inst-opt",
+                    "retdec-register-localization",
+                    "retdec-value-protect",
+                    "instcombine",
+                    "simplifycfg",
+                    "mem2reg",
+                    "early-cse",
+                    "instcombine",
+                    "simplifycfg",
+                    "adce",
+                    "globaldce",
+                    "retdec-inst-opt",
+                    "retdec-simple-types",
+                    "retdec-stack-ptr-op-remove",
+                    "retdec-idioms",
+                    "instcombine",
+                    "retdec-inst-opt",
+                    "retdec-idioms",
+                    "retdec-remove-phi",
+                    "sink",
+                    "verify",
+                    "loops",
+                    "scalar-evolution",
+                    "retdec-value-protect",
+                    "retdec-write-ll",
+                    "retdec-write-bc",
+                    "retdec-llvmir2hll"
+                ]
+            }
+        },
+        "balanced": {
+            "help": "single full LLVM optimization round, no crypto patterns",
+            "decompParams": {
+                "cryptoPatternPaths": [],
+                "llvmPasses" : [
+                    "retdec-provider-init",
+                    "retdec-decoder",
+                    "verify",
+                    "retdec-x86-addr-spaces",
+                    "retdec-x87-fpu",
+                    "retdec-main-detection",
+                    "retdec-idioms-libgcc",
+                    "retdec-inst-opt",
+                    "retdec-cond-branch-opt",
+                    "retdec-syscalls",
+                    "retdec-stack",
+                    "retdec-constants",
+                    "retdec-param-return",
+                    "retdec-inst-opt-rda",
+                    "retdec-inst-opt",
+                    "retdec-simple-types",
+                    "retdec-write-dsm",
+                    "retdec-remove-asm-instrs",
+                    "retdec-class-hierarchy",
+                    "retdec-select-fncs",
+                    "retdec-unreachable-funcs",
+                    "retdec-inst-opt",
+                    "retdec-register-localization",
+                    "retdec-value-protect",
+                    "instcombine",
+                    "tbaa",
+                    "basicaa",
+                    "simplifycfg",
+                    "early-cse",
+                    "tbaa",
+                    "basicaa",
+                    "globalopt",
+                    "mem2reg",
+                    "instcombine",
+                    "simplifycfg",
+                    "early-cse",
+                    "lazy-value-info",
+                    "jump-threading",
+                    "correlated-propagation",
+                    "simplifycfg",
+                    "instcombine",
+                    "simplifycfg",
+                    "reassociate",
+                    "loops",
+                    "loop-simplify",
+                    "lcssa",
+                    "loop-rotate",
+                    "licm",
+                    "lcssa",
+                    "instcombine",
+                    "loop-simplifycfg",
+                    "loop-simplify",
+                    "aa",
+                    "loop-accesses",
+                    "loop-load-elim",
+                    "lcssa",
+                    "indvars",
+                    "loop-idiom",
+                    "loop-deletion",
+                    "gvn",
+                    "sccp",
+                    "instcombine",
+                    "lazy-value-info",
+                    "jump-threading",
+                    "correlated-propagation",
+                    "dse",
+                    "bdce",
+                    "adce",
+                    "simplifycfg",
+                    "instcombine",
+                    "strip-dead-prototypes",
+                    "globaldce",
+                    "constmerge",
+                    "constprop",
+                    "instcombine",
+                    "retdec-inst-opt",
+                    "retdec-simple-types",
+                    "retdec-stack-ptr-op-remove",
+                    "retdec-idioms",
+                    "instcombine",
+                    "retdec-inst-opt",
+                    "retdec-idioms",
+                    "retdec-remove-phi",
+                    "sink",
+                    "verify",
+                    "loops",
+                    "scalar-evolution",
+                    "retdec-value-protect",
+                    "retdec-write-ll",
+                    "retdec-write-bc",
+                    "retdec-llvmir2hll"
+                ]
+            }
+        },
+        "full": {
+            "help": "default RetDec pipeline with two optimization rounds and crypto patterns",
+            "decompParams": {}
+        }
+    }
+}
+)";
+
+}
+}
@@ -0,0 +1,316 @@
+/**
+ * @file src/r2plugin/r2cache.cpp
+ * @brief Compact binary cache of decompilation results.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2metrics.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+/// Identification of the cache file.
+const char CacheMagic[4] = {'R', 'D', 'C', 'M'};
+
+/// Written as is. Reading it in different order means foreign byte order.
+const uint16_t ByteOrderMark = 0x0102;
+
+struct Header {
+	char magic[4];
+	uint16_t version;
+	uint16_t byteOrder;
+	uint32_t itemCount;
+	uint32_t keyLength;
+	uint64_t codeLength;
+	uint64_t checksum;
+	uint32_t rangeCount;
+	uint32_t lineCount;
+	uint32_t addressLineCount;
+	uint32_t reserved;
+};
+
+std::mutex memoryMutex;
+
+}
+
+const uint16_t CodeCache::Version = 2;
+const size_t CodeCache::_memoryCapacity = 64;
+std::list<std::pair<std::string, std::vector<uint8_t>>> CodeCache::_memory;
+std::map<std::string, decltype(CodeCache::_memory)::iterator> CodeCache::_memoryIndex;
+
+/**
+ * FNV-1a hash of the provided data. Used to detect corrupted cache files.
+ */
+uint64_t CodeCache::checksum(const uint8_t* data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Converts annotated code into the binary representation.
+ *
+ * Only annotations produced by R2CGenerator (offsets and syntax
+ * highlighting) are stored. Other types carry strings and are skipped.
+ */
+std::vector<uint8_t> CodeCache::serialize(
+		const std::string& key,
+		const RCodeMeta& code,
+		const CodeIndex& index)
+{
+	std::vector<PackedItem> items;
+	items.reserve(code.annotations.len);
+
+	auto annotations = static_cast<const RCodeMetaItem*>(code.annotations.a);
+	for (size_t i = 0; i < code.annotations.len; i++) {
+		const RCodeMetaItem *mi = &annotations[i];
+		PackedItem item{mi->start, mi->end, 0, static_cast<uint32_t>(mi->type), 0};
+		if (mi->type == R_CODEMETA_TYPE_OFFSET)
+			item.payload = mi->offset.offset;
+		else if (mi->type == R_CODEMETA_TYPE_SYNTAX_HIGHLIGHT)
+			item.payload = mi->syntax_highlight.type;
+		else
+			continue;
+
+		items.push_back(item);
+	}
+
+	size_t codeLength = code.code ? strlen(code.code) : 0;
+
+	Header header;
+	memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = Version;
+	header.byteOrder = ByteOrderMark;
+	header.itemCount = items.size();
+	header.keyLength = key.size();
+	header.codeLength = codeLength;
+	header.rangeCount = index.ranges().size();
+	header.lineCount = index.lines().size();
+	header.addressLineCount = index.addressLines().size();
+	header.reserved = 0;
+
+	size_t itemsSize = items.size() * sizeof(PackedItem);
+	std::vector<uint8_t> data(sizeof(Header) + key.size() + codeLength + itemsSize);
+
+	uint8_t* body = data.data() + sizeof(Header);
+	memcpy(body, key.data(), key.size());
+	memcpy(body + key.size(), code.code, codeLength);
+	memcpy(body + key.size() + codeLength, items.data(), itemsSize);
+
+	index.serialize(data);
+
+	body = data.data() + sizeof(Header);
+	header.checksum = checksum(body, data.size() - sizeof(Header));
+	memcpy(data.data(), &header, sizeof(Header));
+
+	return data;
+}
+
+/**
+ * Creates annotated code from its binary representation.
+ *
+ * @returns nullptr when the data are not valid, were created by another
+ *          version of the plugin or for a different key.
+ */
+RCodeMeta* CodeCache::deserialize(
+		const std::vector<uint8_t>& data,
+		const std::string& key,
+		CodeIndex* index)
+{
+	Header header;
+	if (data.size() < sizeof(Header))
+		return nullptr;
+
+	memcpy(&header, data.data(), sizeof(Header));
+	if (memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0
+			|| header.version != Version
+			|| header.byteOrder != ByteOrderMark)
+		return nullptr;
+
+	size_t itemsSize = size_t(header.itemCount) * sizeof(PackedItem);
+	size_t itemsEnd = sizeof(Header) + header.keyLength + header.codeLength + itemsSize;
+	if (data.size() < itemsEnd)
+		return nullptr;
+
+	const uint8_t* body = data.data() + sizeof(Header);
+	if (checksum(body, data.size() - sizeof(Header)) != header.checksum)
+		return nullptr;
+
+	if (key != std::string(reinterpret_cast<const char*>(body), header.keyLength))
+		return nullptr;
+
+	auto codeIndex = CodeIndex::deserialize(
+		data.data() + itemsEnd,
+		data.size() - itemsEnd,
+		header.rangeCount,
+		header.lineCount,
+		header.addressLineCount);
+	if (!codeIndex.has_value())
+		return nullptr;
+
+	if (index != nullptr)
+		*index = std::move(codeIndex.value());
+
+	body += header.keyLength;
+
+	RCodeMeta *code = r_codemeta_new(nullptr);
+	if (code == nullptr) {
+		throw DecompilationError("unable to allocate memory");
+	}
+
+	code->code = reinterpret_cast<char *>(r_malloc(header.codeLength + 1));
+	if (!code->code) {
+		r_codemeta_free(code);
+		throw DecompilationError("unable to allocate memory");
+	}
+	memcpy(code->code, body, header.codeLength);
+	code->code[header.codeLength] = '\0';
+
+	body += header.codeLength;
+
+	std::vector<PackedItem> items(header.itemCount);
+	memcpy(items.data(), body, itemsSize);
+
+	for (auto& item: items) {
+		RCodeMetaItem *mi = r_codemeta_item_new();
+		mi->type = static_cast<RCodeMetaItemType>(item.type);
+		mi->start = item.start;
+		mi->end = item.end;
+		if (mi->type == R_CODEMETA_TYPE_OFFSET)
+			mi->offset.offset = item.payload;
+		else
+			mi->syntax_highlight.type = static_cast<RSyntaxHighlightType>(item.payload);
+
+		r_codemeta_add_item(code, mi);
+	}
+
+	return code;
+}
+
+/**
+ * Stores annotated code with its index into the cache file and keeps
+ * copy in memory.
+ */
+void CodeCache::save(
+		const fs::path& path,
+		const std::string& key,
+		const RCodeMeta& code,
+		const CodeIndex& index)
+{
+	auto data = serialize(key, code, index);
+
+	std::error_code err;
+	fs::create_directories(path.parent_path(), err);
+
+	std::ofstream cacheFile(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (cacheFile) {
+		cacheFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+		cacheFile.close();
+		Metrics::increment(Metrics::Counter::BytesWritten, data.size());
+	}
+
+	memoryStore(path.string(), std::move(data));
+}
+
+/**
+ * Loads annotated code from memory or from the cache file.
+ *
+ * @param index When provided, it is filled with the cached index.
+ *
+ * @returns nullptr if no usable cached result was found.
+ */
+RCodeMeta* CodeCache::load(const fs::path& path, const std::string& key, CodeIndex* index)
+{
+	{
+		std::lock_guard<std::mutex> lock(memoryMutex);
+		if (auto data = memoryLookup(path.string())) {
+			if (auto code = deserialize(*data, key, index)) {
+				Metrics::cacheLookup(Metrics::CacheTier::Memory, true);
+				return code;
+			}
+		}
+	}
+
+	Metrics::cacheLookup(Metrics::CacheTier::Memory, false);
+
+	std::ifstream cacheFile(path, std::ios::in | std::ios::binary);
+	if (!cacheFile) {
+		Metrics::cacheLookup(Metrics::CacheTier::Disk, false);
+		return nullptr;
+	}
+
+	std::vector<uint8_t> data;
+	cacheFile.seekg(0, std::ios::end);
+	data.resize(cacheFile.tellg());
+	cacheFile.seekg(0, std::ios::beg);
+	cacheFile.read(reinterpret_cast<char*>(data.data()), data.size());
+	cacheFile.close();
+	Metrics::increment(Metrics::Counter::BytesRead, data.size());
+
+	auto code = deserialize(data, key, index);
+	Metrics::cacheLookup(Metrics::CacheTier::Disk, code != nullptr);
+	if (code != nullptr)
+		memoryStore(path.string(), std::move(data));
+
+	return code;
+}
+
+/**
+ * Finds cached data in memory and marks them as most recently used.
+ * Caller is required to hold memoryMutex.
+ */
+const std::vector<uint8_t>* CodeCache::memoryLookup(const std::string& path)
+{
+	auto it = _memoryIndex.find(path);
+	if (it == _memoryIndex.end())
+		return nullptr;
+
+	_memory.splice(_memory.begin(), _memory, it->second);
+	return &it->second->second;
+}
+
+/**
+ * Keeps data in memory. Least recently used entries are dropped when
+ * capacity is exceeded.
+ */
+void CodeCache::memoryStore(const std::string& path, std::vector<uint8_t> data)
+{
+	std::lock_guard<std::mutex> lock(memoryMutex);
+
+	auto it = _memoryIndex.find(path);
+	if (it != _memoryIndex.end()) {
+		_memory.erase(it->second);
+		_memoryIndex.erase(it);
+	}
+
+	_memory.emplace_front(path, std::move(data));
+	_memoryIndex[path] = _memory.begin();
+
+	while (_memory.size() > _memoryCapacity) {
+		_memoryIndex.erase(_memory.back().first);
+		_memory.pop_back();
+	}
+}
+
+/**
+ * Drops all results kept in memory. Results cached on disk are kept.
+ */
+void CodeCache::clearMemory()
+{
+	std::lock_guard<std::mutex> lock(memoryMutex);
+
+	_memory.clear();
+	_memoryIndex.clear();
+}
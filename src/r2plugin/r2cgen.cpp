@@ -9,6 +9,7 @@
 
 #include "r2plugin/r2data.h"
 #include "r2plugin/r2cgen.h"
+#include "r2plugin/r2stats.h"
 
 using namespace retdec::r2plugin;
 
@@ -146,11 +147,23 @@ RCodeMeta* R2CGenerator::generateOutput(const std::string &rdoutJson) const
 	jsonFile.read(&jsonContent[0], jsonContent.size());
 	jsonFile.close();
 
+	return generateOutputFromString(jsonContent);
+}
+
+/**
+ * Generates output from RetDec's JSON output that is kept in memory.
+ */
+RCodeMeta* R2CGenerator::generateOutputFromString(const std::string &jsonContent) const
+{
 	rapidjson::Document root;
-	rapidjson::ParseResult success = root.Parse(jsonContent);
-	if (!success) {
-		throw DecompilationError("unable to parse RetDec JSON output");
+	{
+		Stats::Timer timer(Stats::Phase::JsonParse);
+		rapidjson::ParseResult success = root.Parse(jsonContent);
+		if (!success) {
+			throw DecompilationError("unable to parse RetDec JSON output");
+		}
 	}
 
+	Stats::Timer timer(Stats::Phase::Annotations);
 	return provideAnnotations(root);
 }
@@ -0,0 +1,234 @@
+/**
+ * @file src/r2plugin/r2cost.cpp
+ * @brief Cost model of decompilation of a single function.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "r2plugin/r2cost.h"
+#include "r2plugin/r2retdec.h"
+
+using namespace retdec::r2plugin;
+
+const std::string CostModel::ProfileName = "auto";
+
+const size_t CostModel::CalibrationWindow = 256;
+
+/**
+ * Thunks and other trivial functions get the fast profile. Outliers
+ * are degraded to cheaper profiles. Last tier covers everything else.
+ */
+const std::vector<CostModel::Tier> CostModel::_tiers = {
+	{300.0, "fast"},
+	{30000.0, "full"},
+	{120000.0, "balanced"},
+	{INFINITY, "fast"}
+};
+
+std::mutex CostModel::_mutex;
+std::map<std::string, CostModel::Pending> CostModel::_pending;
+std::map<std::string, std::vector<double>> CostModel::_ratios;
+bool CostModel::_ratiosLoaded = false;
+
+/**
+ * Empty body for the destructor. The will forbid CostModel class
+ * to be instanciated.
+ */
+CostModel::~CostModel()
+{
+}
+
+/**
+ * @brief Linear model of decompilation time in milliseconds.
+ *
+ * Base cost covers loading of the input and the backend. Blocks
+ * and complexity drive control-flow analyses and structuring,
+ * callees drive param-return analysis.
+ */
+double CostModel::uncalibrated(const R2FunctionMetrics& metrics)
+{
+	return 150.0
+		+ 0.8 * metrics.instructions
+		+ 4.0 * metrics.blocks
+		+ 10.0 * metrics.complexity
+		+ 20.0 * metrics.callees;
+}
+
+fs::path CostModel::logPath()
+{
+	return getOutDirPath()/"rd_cost.csv";
+}
+
+/**
+ * Loads ratios of actual and estimated times from the recent records.
+ * Expects the mutex to be locked.
+ */
+void CostModel::loadRatios()
+{
+	if (_ratiosLoaded)
+		return;
+
+	_ratiosLoaded = true;
+
+	std::ifstream log(logPath());
+	std::string line;
+	while (std::getline(log, line)) {
+		// function,instructions,blocks,complexity,callees,profile,estimate,uncalibrated,actual
+		// Parsed from the end as function names may contain commas.
+		size_t fields[4];
+		auto pos = line.size();
+		bool valid = true;
+		for (auto& field: fields) {
+			pos = pos == 0 ? std::string::npos : line.find_last_of(',', pos-1);
+			if (pos == std::string::npos) {
+				valid = false;
+				break;
+			}
+			field = pos;
+		}
+
+		if (!valid)
+			continue;
+
+		// fields: actual, uncalibrated, estimate, profile
+		auto profile = line.substr(fields[3]+1, fields[2]-fields[3]-1);
+		double raw = std::atof(line.c_str()+fields[1]+1);
+		double actual = std::atof(line.c_str()+fields[0]+1);
+		if (raw > 0 && actual > 0)
+			_ratios[profile].push_back(actual/raw);
+	}
+
+	for (auto& [_, ratios]: _ratios)
+		if (ratios.size() > CalibrationWindow)
+			ratios.erase(ratios.begin(), ratios.end()-CalibrationWindow);
+}
+
+/**
+ * @brief Returns median ratio of actual and estimated times of the profile.
+ *
+ * Profile without records takes calibration of the default profile.
+ */
+double CostModel::calibration(const std::string& profile)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	loadRatios();
+
+	auto it = _ratios.find(profile);
+	if (it == _ratios.end() || it->second.empty())
+		it = _ratios.find(Profile::DefaultName);
+	if (it == _ratios.end() || it->second.empty())
+		return 1.0;
+
+	auto ratios = it->second;
+	auto middle = ratios.begin() + ratios.size()/2;
+	std::nth_element(ratios.begin(), middle, ratios.end());
+
+	return *middle;
+}
+
+/**
+ * @brief Estimates cost of the function and selects resources for it.
+ */
+CostEstimate CostModel::estimate(const R2FunctionMetrics& metrics)
+{
+	double raw = uncalibrated(metrics);
+	double reference = raw * calibration();
+
+	auto tier = std::find_if(_tiers.begin(), _tiers.end(),
+		[reference](const Tier& t) {
+			return reference < t.milliseconds;
+		});
+
+	double milliseconds = raw * calibration(tier->profile);
+
+	// Time is given a generous margin as the model is coarse.
+	// Timeout is in seconds.
+	uint64_t timeout = std::max<uint64_t>(30, std::ceil(milliseconds*4/1000));
+
+	// Memory grows mostly with the size of the LLVM module.
+	uint64_t memoryLimit = (256ull << 20)
+		+ metrics.instructions * (64ull << 10)
+		+ metrics.blocks * (1ull << 20);
+	memoryLimit = std::clamp<uint64_t>(memoryLimit, 512ull << 20, 8ull << 30);
+
+	return {milliseconds, tier->profile, timeout, memoryLimit};
+}
+
+/**
+ * @brief Remembers estimate of the job identified by its output file.
+ */
+void CostModel::expect(
+		const std::string& job,
+		const std::string& function,
+		const R2FunctionMetrics& metrics,
+		const CostEstimate& estimate)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_pending[job] = {function, metrics, estimate};
+}
+
+/**
+ * @brief Records actual time of the job next to its estimate.
+ *
+ * Jobs without estimate (not decompiled with the auto profile)
+ * are ignored.
+ */
+void CostModel::observe(const std::string& job, double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _pending.find(job);
+	if (it == _pending.end())
+		return;
+
+	auto pending = std::move(it->second);
+	_pending.erase(it);
+
+	loadRatios();
+
+	double raw = uncalibrated(pending.metrics);
+	auto& ratios = _ratios[pending.estimate.profile];
+	ratios.push_back(milliseconds/raw);
+	if (ratios.size() > CalibrationWindow)
+		ratios.erase(ratios.begin());
+
+	std::ostringstream record;
+	record << pending.function
+		<< "," << pending.metrics.instructions
+		<< "," << pending.metrics.blocks
+		<< "," << pending.metrics.complexity
+		<< "," << pending.metrics.callees
+		<< "," << pending.estimate.profile
+		<< "," << pending.estimate.milliseconds
+		<< "," << raw
+		<< "," << milliseconds;
+
+	// Log is best effort, failure to write it must not fail decompilation.
+	std::ofstream log(logPath(), std::ios::app);
+	log << record.str() << std::endl;
+}
+
+/**
+ * @brief Forgets estimate of the job that will not be observed.
+ */
+void CostModel::forget(const std::string& job)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_pending.erase(job);
+}
+
+CostModel::Expectation::Expectation(const std::string& job):
+	_job(job)
+{
+}
+
+CostModel::Expectation::~Expectation()
+{
+	forget(_job);
+}
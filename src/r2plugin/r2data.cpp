@@ -4,9 +4,14 @@
  * @copyright (c) 2020 Avast Software, licensed under the MIT license.
  */
 
+#include <algorithm>
+#include <set>
+
+#include <rapidjson/document.h>
 #include <retdec/utils/io/log.h>
 
 #include "r2plugin/r2data.h"
+#include "r2plugin/r2metrics.h"
 #include "r2plugin/r2utils.h"
 
 using namespace retdec::common;
@@ -82,6 +87,23 @@ std::string sanitize(const std::string& a)
 	return ok.str();
 }
 
+/**
+ * @brief Renames function at the address in r2 without changing its signature.
+ *
+ * Function types known to r2 by the new name are used by subsequent
+ * fetches of the function.
+ */
+void R2Database::renameFunction(R2Address addr, const std::string& name) const
+{
+	auto r2fnc = r_anal_get_function_at(_r2core.anal, addr);
+	if (r2fnc == nullptr || r_anal_function_rename(r2fnc, name.c_str()) == false) {
+		std::ostringstream err;
+		err << "unable to rename function at offset " << std::hex << addr
+			<< " to \"" << name << "\"";
+		throw DecompilationError(err.str());
+	}
+}
+
 void R2Database::copyFunctionData(const common::Function &fnc, RAnalFunction &r2fnc) const
 {
 	if (r_anal_function_rename(&r2fnc, fnc.getName().c_str()) == false) {
@@ -405,6 +427,226 @@ size_t R2Database::fetchWordSize() const
 	return r_config_get_i(_r2core.config, "asm.bits");
 }
 
+/**
+ * @brief Fetches architecture of the code as it is set in Radare2.
+ */
+R2Architecture R2Database::fetchArchitecture() const
+{
+	auto arch = r_config_get(_r2core.config, "asm.arch");
+	return {
+		arch ? arch : "",
+		fetchWordSize(),
+		r_config_get_i(_r2core.config, "cfg.bigendian") != 0
+	};
+}
+
+/**
+ * @brief Fetches sections and segments of the input file parsed by Radare2.
+ */
+std::vector<R2Section> R2Database::fetchSections() const
+{
+	std::vector<R2Section> result;
+
+	auto list = r_bin_get_sections(_r2core.bin);
+	if (list == nullptr)
+		return result;
+
+	for (RListIter *it = list->head; it; it = it->n) {
+		auto sec = reinterpret_cast<RBinSection*>(it->data);
+		if (sec == nullptr)
+			continue;
+
+		result.push_back({
+			sec->name ? sec->name : "",
+			sec->vaddr,
+			sec->vsize,
+			sec->paddr,
+			sec->size,
+			sec->perm
+		});
+	}
+
+	return result;
+}
+
+/**
+ * @brief Fetches references from the function at the given address.
+ *
+ * References are obtained from the output of axffj command as the API
+ * for accessing references differs between Radare2 versions.
+ */
+std::vector<R2Reference> R2Database::fetchFunctionReferences(R2Address addr) const
+{
+	std::vector<R2Reference> result;
+
+	std::ostringstream cmd;
+	cmd << "axffj @ 0x" << std::hex << addr;
+
+	char* output = r_core_cmd_str(&_r2core, cmd.str().c_str());
+	if (output == nullptr)
+		return result;
+
+	rapidjson::Document root;
+	root.Parse(output);
+	r_free(output);
+
+	if (root.HasParseError() || !root.IsArray())
+		return result;
+
+	for (auto& ref: root.GetArray()) {
+		if (!ref.IsObject() || !ref.HasMember("type")
+				|| !ref.HasMember("at") || !ref.HasMember("ref"))
+			continue;
+
+		result.push_back({
+			ref["type"].GetString(),
+			ref["at"].GetUint64(),
+			ref["ref"].GetUint64(),
+			ref.HasMember("name") && ref["name"].IsString() ? ref["name"].GetString() : ""
+		});
+	}
+
+	return result;
+}
+
+/**
+ * @brief Fetches metrics of the function used to estimate cost
+ *        of its decompilation.
+ */
+R2FunctionMetrics R2Database::fetchFunctionMetrics(const Function& fnc) const
+{
+	R2FunctionMetrics metrics = {0, 0, 0, 0};
+
+	auto r2fnc = r_anal_get_function_at(_r2core.anal, fnc.getStart().getValue());
+	if (r2fnc == nullptr)
+		return metrics;
+
+	metrics.instructions = r2fnc->ninstr;
+	metrics.blocks = r_list_length(r2fnc->bbs);
+	metrics.complexity = r_anal_function_complexity(r2fnc);
+
+	std::set<R2Address> callees;
+	for (auto& ref: fetchFunctionReferences(fnc.getStart()))
+		if (ref.type == "CALL")
+			callees.insert(ref.to);
+
+	metrics.callees = callees.size();
+
+	return metrics;
+}
+
+/**
+ * @brief Describes the state of the IO layer: opened files, maps
+ *        and writes held by io.cache.
+ *
+ * State is obtained from the output of oj, omj and wc* commands as
+ * the API of the IO layer differs between Radare2 versions. Its size
+ * depends on the number of maps and cached writes, not on the size
+ * of mapped memory.
+ */
+std::string R2Database::fetchIOState() const
+{
+	std::string state;
+	for (auto cmd: {"oj", "omj", "wc*"}) {
+		char* output = r_core_cmd_str(&_r2core, cmd);
+		if (output != nullptr) {
+			state += output;
+			r_free(output);
+		}
+		state += "\n";
+	}
+
+	return state;
+}
+
+/**
+ * @brief Fetches content of the input file that Radare2 holds in memory.
+ */
+std::vector<uint8_t> R2Database::fetchFileBytes() const
+{
+	RBinFile *bf = r_bin_cur(_r2core.bin);
+	if (bf == nullptr || bf->buf == nullptr)
+		throw DecompilationError("no binary file is loaded");
+
+	std::vector<uint8_t> data(r_buf_size(bf->buf));
+	if (r_buf_read_at(bf->buf, 0, data.data(), data.size()) != static_cast<st64>(data.size()))
+		throw DecompilationError("unable to read content of the binary file");
+
+	Metrics::increment(Metrics::Counter::BytesRead, data.size());
+	return data;
+}
+
+/**
+ * @brief Reads memory as it is mapped by the Radare2 IO layer.
+ *
+ * Result reflects patches, io.cache and other maps opened by user.
+ */
+std::vector<uint8_t> R2Database::fetchBytes(R2Address addr, size_t size) const
+{
+	static const size_t chunkSize = 1 << 20;
+
+	std::vector<uint8_t> data(size);
+	for (size_t done = 0; done < size; done += chunkSize) {
+		size_t len = std::min(chunkSize, size-done);
+		r_io_read_at(_r2core.io, addr+done, data.data()+done, len);
+	}
+
+	Metrics::increment(Metrics::Counter::BytesRead, size);
+	return data;
+}
+
+/**
+ * @brief Fetches bytes of the function with operands that depend
+ *        on its placement (addresses, relocations) masked out.
+ */
+std::vector<uint8_t> R2Database::fetchNormalizedBytes(const Function& fnc) const
+{
+	auto bytes = fetchBytes(fnc.getStart(), fnc.getSize());
+	normalizeBytes(bytes, fnc.getStart());
+
+	return bytes;
+}
+
+/**
+ * @brief Masks out operands of code placed at the address that depend
+ *        on its placement.
+ *
+ * Mask is provided by analysis plugin of the architecture. Code does not
+ * have to be loaded in r2, so the same normalization can be applied to
+ * code from other files.
+ */
+void R2Database::normalizeBytes(std::vector<uint8_t>& bytes, R2Address addr) const
+{
+	ut8* mask = r_anal_mask(_r2core.anal, bytes.size(), bytes.data(), addr);
+	if (mask == nullptr)
+		return;
+
+	for (size_t i = 0; i < bytes.size(); i++)
+		bytes[i] &= mask[i];
+
+	r_free(mask);
+}
+
+/**
+ * @brief Fetches all functions known to Radare2.
+ */
+std::vector<Function> R2Database::fetchFunctions() const
+{
+	std::vector<Function> result;
+
+	auto list = r_anal_get_fcns(_r2core.anal);
+	if (list == nullptr)
+		return result;
+
+	for (RListIter *it = list->head; it; it = it->n) {
+		auto fnc = reinterpret_cast<RAnalFunction*>(it->data);
+		if (fnc != nullptr)
+			result.push_back(convertFunctionObject(*fnc));
+	}
+
+	return result;
+}
+
 ut64 R2Database::seekedAddress() const
 {
 	return _r2core.offset;
@@ -0,0 +1,344 @@
+/**
+ * @file src/r2plugin/r2dedup.cpp
+ * @brief Sharing of decompilation results between identical functions.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2dedup.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2retdec.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+bool isIdentifierChar(char c)
+{
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/**
+ * Writes names and types of the function, its parameters and locals
+ * as they are set in r2.
+ */
+void describeAnnotations(std::ostream& data, const retdec::common::Function& fnc)
+{
+	data << fnc.getDeclarationString() << "\n"
+		<< fnc.returnType.getLlvmIr() << "\n";
+
+	for (auto& param: fnc.parameters)
+		data << "param:" << param.type.getLlvmIr() << " " << param.getName() << "\n";
+
+	for (auto& local: fnc.locals)
+		data << "local:" << local.type.getLlvmIr() << " " << local.getName() << "\n";
+}
+
+}
+
+std::atomic<uint64_t> DedupStore::_hits(0);
+
+/**
+ * Empty body for the destructor. The will forbid DedupStore class
+ * to be instanciated.
+ */
+DedupStore::~DedupStore()
+{
+}
+
+bool DedupStore::isEnabled()
+{
+	return Environment::isEnabled("DEC_DEDUP");
+}
+
+/**
+ * @brief Number of results served from the store in this session.
+ */
+uint64_t DedupStore::hits()
+{
+	return _hits;
+}
+
+fs::path DedupStore::storePath(const std::string& key)
+{
+	return getOutDirPath()/"dedup"/(key+".bin");
+}
+
+/**
+ * @brief Computes key of the function.
+ *
+ * Functions with the same key differ only in placement. References
+ * to named objects are part of the key so that functions calling
+ * different functions are not shared. Prototype and variables of the
+ * function set in r2 are part of the key so that renames and retypes
+ * made by user are reflected.
+ */
+std::string DedupStore::key(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const config::Config& config)
+{
+	std::ostringstream data;
+
+	auto arch = binInfo.fetchArchitecture();
+	data << arch.name << "/" << arch.bits << "/" << arch.bigEndian << "\n";
+
+	for (auto& pass: config.parameters.llvmPasses)
+		data << pass << ",";
+	data << "\n";
+
+	// Name of the function itself is rebased.
+	for (auto& configFnc: config.functions) {
+		if (configFnc.getStart() == fnc.getStart()) {
+			describeAnnotations(data, configFnc);
+			break;
+		}
+	}
+
+	for (auto& ref: binInfo.fetchFunctionReferences(fnc.getStart())) {
+		data << ref.type << "@" << std::hex << (ref.from - fnc.getStart()) << ":";
+		if (!ref.name.empty())
+			data << ref.name;
+		else
+			data << "+" << (ref.to - fnc.getStart());
+		data << "\n";
+	}
+
+	auto prefix = data.str();
+	auto bytes = binInfo.fetchNormalizedBytes(fnc);
+	bytes.insert(bytes.begin(), prefix.begin(), prefix.end());
+
+	std::ostringstream key;
+	key << std::hex << CodeCache::checksum(bytes.data(), bytes.size())
+		<< "-" << std::dec << fnc.getSize().getValue();
+
+	return key.str();
+}
+
+bool DedupStore::contains(const std::string& key)
+{
+	auto path = storePath(key);
+
+	std::error_code err;
+	return fs::is_regular_file(path, err)
+		&& fs::is_regular_file(fs::path(path).replace_extension(".origin"), err);
+}
+
+/**
+ * @brief Returns result stored under the key rebased onto the function.
+ *
+ * @returns nullptr when there is no result for the key.
+ */
+RCodeMeta* DedupStore::lookup(
+		const std::string& key,
+		const common::Function& fnc,
+		CodeIndex* index)
+{
+	auto path = storePath(key);
+
+	// Origin is stored as: <start>\t<end>\t<name>
+	std::ifstream originFile(fs::path(path).replace_extension(".origin"));
+	std::string line;
+	if (!std::getline(originFile, line))
+		return nullptr;
+
+	std::istringstream origin(line);
+	uint64_t start = 0, end = 0;
+	std::string name;
+	if (!(origin >> start >> end) || !std::getline(origin >> std::ws, name))
+		return nullptr;
+
+	auto code = CodeCache::load(path, key);
+	if (code == nullptr)
+		return nullptr;
+
+	auto rebased = rebase(*code, common::Function(start, end, name), fnc);
+	r_codemeta_free(code);
+
+	if (index != nullptr)
+		*index = CodeIndex(*rebased);
+
+	_hits++;
+	return rebased;
+}
+
+/**
+ * @brief Stores the result under the key unless it is bound to
+ *        the placement of the function.
+ *
+ * @returns false when the result was not stored.
+ */
+bool DedupStore::store(
+		const R2Database& binInfo,
+		const std::string& key,
+		const common::Function& fnc,
+		const RCodeMeta& code)
+{
+	if (embedsAddresses(code, fnc, binInfo.fetchFunctionReferences(fnc.getStart())))
+		return false;
+
+	auto path = storePath(key);
+	CodeCache::save(path, key, code, CodeIndex(code));
+
+	std::ofstream origin(fs::path(path).replace_extension(".origin"), std::ios::trunc);
+	origin << fnc.getStart().getValue() << "\t" << fnc.getEnd().getValue()
+		<< "\t" << fnc.getName() << "\n";
+
+	return true;
+}
+
+/**
+ * @brief Checks whether the text of the code contains an address
+ *        of the function or of an unnamed object it references.
+ *
+ * Such addresses (literals, names RetDec derives from addresses)
+ * are not rebased, so the result cannot be shared.
+ */
+bool DedupStore::embedsAddresses(
+		const RCodeMeta& code,
+		const common::Function& fnc,
+		const std::vector<R2Reference>& references)
+{
+	std::set<R2Address> targets;
+	for (auto& ref: references)
+		if (ref.name.empty())
+			targets.insert(ref.to);
+
+	auto isEmbedded = [&](const std::string& digits) {
+		if (digits.empty() || digits.size() > 16)
+			return false;
+
+		auto address = std::stoull(digits, nullptr, 16);
+		return fnc.contains(address) || address == fnc.getEnd() || targets.count(address) != 0;
+	};
+
+	std::string text(code.code);
+	for (size_t pos = 0; pos < text.size();) {
+		if (!isIdentifierChar(text[pos])) {
+			pos++;
+			continue;
+		}
+
+		auto end = pos;
+		while (end < text.size() && isIdentifierChar(text[end]))
+			end++;
+
+		// Hexadecimal suffix of the token: 0x401000, global_var_401000.
+		auto token = text.substr(pos, end - pos);
+		auto digits = token.find_last_not_of("0123456789abcdefABCDEF");
+		bool prefixed = digits != std::string::npos
+			&& (token[digits] == '_' || (token[digits] == 'x' && digits > 0 && token[digits-1] == '0'));
+
+		if (prefixed && isEmbedded(token.substr(digits+1)))
+			return true;
+
+		pos = end;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Creates copy of the code with name of the function replaced
+ *        and offsets inside of the function shifted.
+ *
+ * Further identifiers (names of callees or globals that moved with
+ * the function) are replaced according to renames.
+ */
+RCodeMeta* DedupStore::rebase(
+		const RCodeMeta& code,
+		const common::Function& from,
+		const common::Function& to,
+		std::map<std::string, std::string> renames)
+{
+	if (!from.getName().empty() && from.getName() != to.getName())
+		renames[from.getName()] = to.getName();
+
+	std::string text(code.code);
+
+	// Start and end of each replaced identifier in the original text
+	// and change of the length of the text it causes.
+	struct Replacement {
+		size_t start;
+		size_t end;
+		int64_t shift;
+	};
+	std::vector<Replacement> replacements;
+
+	std::string rebasedText;
+	rebasedText.reserve(text.size());
+	for (size_t pos = 0; pos < text.size();) {
+		if (!isIdentifierChar(text[pos])) {
+			rebasedText.push_back(text[pos++]);
+			continue;
+		}
+
+		auto end = pos;
+		while (end < text.size() && isIdentifierChar(text[end]))
+			end++;
+
+		auto identifier = text.substr(pos, end - pos);
+		auto rename = renames.find(identifier);
+		if (rename != renames.end()) {
+			rebasedText.append(rename->second);
+			replacements.push_back({pos, end, int64_t(rename->second.size()) - int64_t(identifier.size())});
+		}
+		else
+			rebasedText.append(identifier);
+
+		pos = end;
+	}
+
+	auto mapPosition = [&](size_t pos) {
+		int64_t shift = 0;
+		for (auto& replacement: replacements) {
+			if (replacement.start >= pos)
+				break;
+
+			if (pos < replacement.end) {
+				auto newEnd = int64_t(replacement.end) + shift + replacement.shift;
+				return size_t(std::min<int64_t>(pos + shift, newEnd));
+			}
+
+			shift += replacement.shift;
+		}
+
+		return size_t(pos + shift);
+	};
+
+	RCodeMeta* rebased = r_codemeta_new(rebasedText.c_str());
+	if (rebased == nullptr)
+		throw DecompilationError("unable to allocate memory");
+
+	auto items = static_cast<const RCodeMetaItem*>(code.annotations.a);
+	for (size_t i = 0; i < code.annotations.len; i++) {
+		const auto& item = items[i];
+		if (item.type != R_CODEMETA_TYPE_OFFSET && item.type != R_CODEMETA_TYPE_SYNTAX_HIGHLIGHT)
+			continue;
+
+		RCodeMetaItem *mi = r_codemeta_item_new();
+		mi->type = item.type;
+		mi->start = mapPosition(item.start);
+		mi->end = mapPosition(item.end);
+
+		if (item.type == R_CODEMETA_TYPE_OFFSET) {
+			auto offset = item.offset.offset;
+			if (from.contains(offset) || offset == from.getEnd())
+				offset = offset - from.getStart() + to.getStart();
+			mi->offset.offset = offset;
+		}
+		else
+			mi->syntax_highlight.type = item.syntax_highlight.type;
+
+		r_codemeta_add_item(rebased, mi);
+	}
+
+	return rebased;
+}
@@ -0,0 +1,541 @@
+/**
+ * @file src/r2plugin/r2diff.cpp
+ * @brief Differential decompilation between two builds of a binary.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <sstream>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2dedup.h"
+#include "r2plugin/r2diff.h"
+#include "r2plugin/r2retdec.h"
+#include "r2plugin/r2signature.h"
+#include "r2plugin/r2utils.h"
+
+using namespace retdec::r2plugin;
+using fu = retdec::r2plugin::FormatUtils;
+
+namespace {
+
+/**
+ * Call references of the function ordered by their position in it.
+ */
+std::vector<R2Reference> callsOf(const ManifestEntry& entry)
+{
+	std::vector<R2Reference> calls;
+	for (auto& ref: entry.references)
+		if (ref.type == "CALL")
+			calls.push_back(ref);
+
+	std::sort(calls.begin(), calls.end(),
+		[](const R2Reference& a, const R2Reference& b) {
+			return a.from < b.from;
+		});
+
+	return calls;
+}
+
+/**
+ * Names of functions that RetDec generates when no name is known.
+ */
+bool isGeneratedName(const std::string& name)
+{
+	return name.rfind("fcn_", 0) == 0 || name.rfind("function_", 0) == 0;
+}
+
+}
+
+const size_t Manifest::ReferencedDataSize = 64;
+
+fs::path Manifest::path(const fs::path& binaryDir)
+{
+	return binaryDir/"rd_manifest.tsv";
+}
+
+/**
+ * @brief Describes function of the binary currently opened in r2.
+ */
+ManifestEntry Manifest::describe(const R2Database& binInfo, const common::Function& fnc)
+{
+	ManifestEntry entry;
+	entry.function = fnc;
+
+	auto bytes = binInfo.fetchNormalizedBytes(fnc);
+	entry.hash = CodeCache::checksum(bytes.data(), bytes.size());
+	entry.references = binInfo.fetchFunctionReferences(fnc.getStart());
+
+	// Literals in the output come from the referenced data.
+	std::vector<uint8_t> data;
+	for (auto& ref: entry.references) {
+		if (ref.type != "DATA" && ref.type != "STRING")
+			continue;
+
+		auto content = binInfo.fetchBytes(ref.to, ReferencedDataSize);
+		if (ref.type == "STRING")
+			content.erase(std::find(content.begin(), content.end(), 0), content.end());
+
+		data.insert(data.end(), content.begin(), content.end());
+		data.push_back(0);
+	}
+	entry.dataHash = CodeCache::checksum(data.data(), data.size());
+
+	return entry;
+}
+
+void Manifest::add(ManifestEntry entry)
+{
+	auto start = entry.function.getStart();
+	_entries[start] = std::move(entry);
+}
+
+/**
+ * @brief Records where result of the function decompiled with the config
+ *        is cached.
+ *
+ * Result served from DedupStore is not in the cache of the function,
+ * its key in the store is recorded instead.
+ */
+void Manifest::record(const R2Database& binInfo, R2Address start, const config::Config& config)
+{
+	auto it = _entries.find(start);
+	if (it == _entries.end())
+		return;
+
+	auto cachePath = getCachePath(config);
+	if (fs::is_regular_file(cachePath)) {
+		std::ostringstream hash;
+		constructHash(config, hash);
+
+		it->second.cachePath = cachePath.string();
+		it->second.cacheKey = hash.str();
+		return;
+	}
+
+	if (DedupStore::isEnabled()) {
+		auto key = DedupStore::key(binInfo, it->second.function, config);
+		if (DedupStore::contains(key))
+			it->second.dedupKey = key;
+	}
+}
+
+/**
+ * @brief Takes location of the result of the function from the manifest
+ *        of the previous run of the same binary with the same profile
+ *        when the result is still there.
+ *
+ * @return @c true when the result was taken.
+ */
+bool Manifest::resume(R2Address start, const Manifest& previous)
+{
+	auto it = _entries.find(start);
+	auto prev = previous.find(start);
+	if (it == _entries.end() || prev == nullptr || previous._profile != _profile
+			|| prev->hash != it->second.hash || prev->dataHash != it->second.dataHash)
+		return false;
+
+	if (!prev->cachePath.empty() && fs::is_regular_file(prev->cachePath)) {
+		it->second.cachePath = prev->cachePath;
+		it->second.cacheKey = prev->cacheKey;
+		return true;
+	}
+
+	if (!prev->dedupKey.empty() && DedupStore::contains(prev->dedupKey)) {
+		it->second.dedupKey = prev->dedupKey;
+		return true;
+	}
+
+	return false;
+}
+
+void Manifest::setProfile(const std::string& profile)
+{
+	_profile = profile;
+}
+
+const ManifestEntry* Manifest::find(R2Address start) const
+{
+	auto it = _entries.find(start);
+	return it == _entries.end() ? nullptr : &it->second;
+}
+
+const std::map<R2Address, ManifestEntry>& Manifest::entries() const
+{
+	return _entries;
+}
+
+/**
+ * @brief Loads manifest from the file.
+ *
+ * Each line describes one function:
+ *     start end name hash cacheKey cachePath references dataHash dedupKey
+ * separated by tabs. References are separated by spaces, each
+ * consisting of type,from,to,name. Last two columns are missing
+ * in manifests of older versions. Comment line "# profile <name>"
+ * names the profile the results were decompiled with.
+ *
+ * @throws DecompilationError when the manifest does not exist.
+ */
+Manifest Manifest::load(const fs::path& file)
+{
+	std::ifstream input(file);
+	if (!input)
+		throw DecompilationError("no manifest "+file.string()+": run pdzab on the binary first");
+
+	Manifest manifest;
+
+	const std::string profileHeader = "# profile\t";
+
+	std::string line;
+	while (std::getline(input, line)) {
+		if (line.compare(0, profileHeader.size(), profileHeader) == 0)
+			manifest._profile = line.substr(profileHeader.size());
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::vector<std::string> fields;
+		std::istringstream columns(line);
+		for (std::string field; std::getline(columns, field, '\t');)
+			fields.push_back(field);
+
+		if (fields.size() < 6)
+			continue;
+
+		ManifestEntry entry;
+		entry.function = common::Function(
+			std::stoull(fields[0], nullptr, 16),
+			std::stoull(fields[1], nullptr, 16),
+			fields[2]);
+		entry.hash = std::stoull(fields[3], nullptr, 16);
+		entry.cacheKey = fields[4];
+		entry.cachePath = fields[5];
+
+		std::istringstream refs(fields.size() > 6 ? fields[6] : "");
+		for (std::string ref; refs >> ref;) {
+			auto parts = fu::splitTokens(ref, ',');
+			if (parts.size() < 3)
+				continue;
+
+			entry.references.push_back({
+				parts[0],
+				std::stoull(parts[1], nullptr, 16),
+				std::stoull(parts[2], nullptr, 16),
+				parts.size() > 3 ? parts[3] : ""
+			});
+		}
+
+		if (fields.size() > 7)
+			entry.dataHash = std::stoull(fields[7], nullptr, 16);
+		if (fields.size() > 8)
+			entry.dedupKey = fields[8];
+
+		manifest.add(std::move(entry));
+	}
+
+	return manifest;
+}
+
+void Manifest::save(const fs::path& file) const
+{
+	std::error_code err;
+	fs::create_directories(file.parent_path(), err);
+
+	std::ofstream output(file, std::ios::trunc);
+	if (!output)
+		throw DecompilationError("unable to write manifest: "+file.string());
+
+	output << "# profile\t" << _profile << std::endl;
+	output << "# start\tend\tname\thash\tcache key\tcache path\treferences\tdata hash\tdedup key" << std::endl;
+	output << std::hex;
+	for (auto& [_, entry]: _entries) {
+		output << entry.function.getStart().getValue() << "\t"
+			<< entry.function.getEnd().getValue() << "\t"
+			<< entry.function.getName() << "\t"
+			<< entry.hash << "\t"
+			<< entry.cacheKey << "\t"
+			<< entry.cachePath << "\t";
+
+		for (auto& ref: entry.references)
+			output << ref.type << "," << ref.from << "," << ref.to << "," << ref.name << " ";
+
+		output << "\t" << entry.dataHash << "\t" << entry.dedupKey << "\n";
+	}
+}
+
+/**
+ * Empty body for the destructor. The will forbid BinaryDiff class
+ * to be instanciated.
+ */
+BinaryDiff::~BinaryDiff()
+{
+}
+
+std::string BinaryDiff::kindName(FunctionChange::Kind kind)
+{
+	switch (kind) {
+	case FunctionChange::Kind::Identical:
+		return "identical";
+	case FunctionChange::Kind::Changed:
+		return "changed";
+	case FunctionChange::Kind::Added:
+		return "added";
+	case FunctionChange::Kind::Removed:
+		return "removed";
+	}
+
+	return "";
+}
+
+/**
+ * @brief Matches functions of the previous and the current build.
+ *
+ * Function is identical when its normalized bytes and the data it references
+ * did not change and its calls lead to matched functions. Otherwise matched
+ * function is changed.
+ */
+std::vector<FunctionChange> BinaryDiff::compare(
+		const Manifest& previous,
+		const Manifest& current)
+{
+	// Current start -> previous start and back.
+	std::map<R2Address, R2Address> matched, matchedBack;
+	std::deque<std::pair<R2Address, R2Address>> worklist;
+
+	auto match = [&](R2Address prev, R2Address cur) {
+		if (matched.count(cur) || matchedBack.count(prev))
+			return;
+
+		matched[cur] = prev;
+		matchedBack[prev] = cur;
+		worklist.push_back({prev, cur});
+	};
+
+	// Functions with unique hash in both builds.
+	std::map<uint64_t, std::vector<R2Address>> prevHashes, curHashes;
+	for (auto& [start, entry]: previous.entries())
+		prevHashes[entry.hash].push_back(start);
+	for (auto& [start, entry]: current.entries())
+		curHashes[entry.hash].push_back(start);
+
+	for (auto& [hash, starts]: curHashes) {
+		auto prev = prevHashes.find(hash);
+		if (starts.size() == 1 && prev != prevHashes.end() && prev->second.size() == 1)
+			match(prev->second.front(), starts.front());
+	}
+
+	// Functions with unique names given by symbols.
+	std::map<std::string, std::vector<R2Address>> prevNames, curNames;
+	for (auto& [start, entry]: previous.entries())
+		prevNames[entry.function.getName()].push_back(start);
+	for (auto& [start, entry]: current.entries())
+		curNames[entry.function.getName()].push_back(start);
+
+	for (auto& [name, starts]: curNames) {
+		auto prev = prevNames.find(name);
+		if (isGeneratedName(name) || starts.size() != 1 || prev == prevNames.end() || prev->second.size() != 1)
+			continue;
+
+		match(prev->second.front(), starts.front());
+	}
+
+	// Callees at the same position in calls of matched functions.
+	while (!worklist.empty()) {
+		auto [prev, cur] = worklist.front();
+		worklist.pop_front();
+
+		auto prevCalls = callsOf(*previous.find(prev));
+		auto curCalls = callsOf(*current.find(cur));
+		if (prevCalls.size() != curCalls.size())
+			continue;
+
+		for (size_t i = 0; i < prevCalls.size(); i++) {
+			if (previous.find(prevCalls[i].to) && current.find(curCalls[i].to))
+				match(prevCalls[i].to, curCalls[i].to);
+		}
+	}
+
+	std::vector<FunctionChange> changes;
+	for (auto& [start, entry]: current.entries()) {
+		auto prev = matched.find(start);
+		if (prev == matched.end()) {
+			changes.push_back({FunctionChange::Kind::Added, {}, entry});
+			continue;
+		}
+
+		auto& prevEntry = *previous.find(prev->second);
+		bool identical = prevEntry.hash == entry.hash
+			&& prevEntry.dataHash == entry.dataHash
+			&& prevEntry.references.size() == entry.references.size();
+
+		for (size_t i = 0; identical && i < entry.references.size(); i++) {
+			auto& prevRef = prevEntry.references[i];
+			auto& curRef = entry.references[i];
+
+			identical = prevRef.type == curRef.type
+				&& prevRef.from - prevEntry.function.getStart() == curRef.from - entry.function.getStart();
+
+			// Callee must be the matched function.
+			if (identical && previous.find(prevRef.to)) {
+				auto callee = matched.find(curRef.to);
+				identical = callee != matched.end() && callee->second == prevRef.to;
+			}
+		}
+
+		changes.push_back({
+			identical ? FunctionChange::Kind::Identical : FunctionChange::Kind::Changed,
+			prevEntry,
+			entry
+		});
+	}
+
+	for (auto& [start, entry]: previous.entries())
+		if (!matchedBack.count(start))
+			changes.push_back({FunctionChange::Kind::Removed, entry, {}});
+
+	return changes;
+}
+
+/**
+ * @brief Creates mapping between names used by the previous and the current
+ *        build in code of an identical function.
+ */
+std::map<std::string, std::string> BinaryDiff::renames(
+		const ManifestEntry& previous,
+		const ManifestEntry& current,
+		const Manifest& previousManifest,
+		const Manifest& currentManifest)
+{
+	std::map<std::string, std::string> names;
+
+	auto rename = [&names](const std::string& from, const std::string& to) {
+		if (!from.empty() && !to.empty() && from != to)
+			names[from] = to;
+	};
+
+	for (size_t i = 0; i < previous.references.size() && i < current.references.size(); i++) {
+		auto& prevRef = previous.references[i];
+		auto& curRef = current.references[i];
+
+		auto prevFnc = previousManifest.find(prevRef.to);
+		auto curFnc = currentManifest.find(curRef.to);
+		if (prevFnc != nullptr && curFnc != nullptr)
+			rename(prevFnc->function.getName(), curFnc->function.getName());
+
+		if (!prevRef.name.empty() && !curRef.name.empty())
+			rename(fu::stripName(prevRef.name), fu::stripName(curRef.name));
+
+		// Names RetDec generates from addresses when nothing is known.
+		std::ostringstream prevAddr, curAddr;
+		prevAddr << std::hex << prevRef.to;
+		curAddr << std::hex << curRef.to;
+		rename("function_"+prevAddr.str(), "function_"+curAddr.str());
+		rename("global_var_"+prevAddr.str(), "global_var_"+curAddr.str());
+	}
+
+	return names;
+}
+
+/**
+ * @brief Stores cached result of the previous build under the key
+ *        of the current function.
+ *
+ * @returns false when the previous result is not available.
+ */
+bool BinaryDiff::carryForward(
+		const R2Database& binInfo,
+		const FunctionChange& change,
+		const std::map<std::string, std::string>& names,
+		Manifest& current)
+{
+	RCodeMeta* code = nullptr;
+	if (!change.previous.cachePath.empty())
+		code = CodeCache::load(change.previous.cachePath, change.previous.cacheKey);
+	else if (!change.previous.dedupKey.empty())
+		code = DedupStore::lookup(change.previous.dedupKey, change.previous.function);
+
+	if (code == nullptr)
+		return false;
+
+	auto rebased = DedupStore::rebase(*code, change.previous.function, change.current.function, names);
+	r_codemeta_free(code);
+
+	auto config = createFunctionConfig(binInfo, change.current.function);
+
+	std::ostringstream hash;
+	constructHash(config, hash);
+	CodeCache::save(getCachePath(config), hash.str(), *rebased, CodeIndex(*rebased));
+	r_codemeta_free(rebased);
+
+	current.record(binInfo, change.current.function.getStart(), config);
+	return true;
+}
+
+void BinaryDiff::report(const std::vector<FunctionChange>& changes, const fs::path& file)
+{
+	std::ofstream output(file, std::ios::trunc);
+	output << "# change\tstart\tname\tprevious start\tprevious name" << std::endl;
+	output << std::hex;
+
+	for (auto& change: changes) {
+		output << kindName(change.kind) << "\t"
+			<< change.current.function.getStart().getValue() << "\t"
+			<< change.current.function.getName() << "\t"
+			<< change.previous.function.getStart().getValue() << "\t"
+			<< change.previous.function.getName() << "\n";
+	}
+}
+
+/**
+ * @brief Brings results of the current binary up to date with
+ *        the previous build processed in the directory.
+ *
+ * Identical functions are carried forward, changed and added functions
+ * are decompiled. Manifest of the current binary and report of changes
+ * (rd_diff.tsv) are written into its directory.
+ */
+std::vector<FunctionChange> BinaryDiff::update(
+		const R2Database& binInfo,
+		const fs::path& previousDir)
+{
+	auto previous = Manifest::load(Manifest::path(previousDir));
+
+	auto libraries = SignatureIndex::identify(binInfo);
+
+	Manifest current;
+	for (auto& fnc: binInfo.fetchFunctions()) {
+		if (!libraries.count(fnc.getStart()))
+			current.add(Manifest::describe(binInfo, fnc));
+	}
+
+	auto changes = compare(previous, current);
+
+	for (auto& change: changes) {
+		if (Governor::isCancelled())
+			break;
+
+		if (change.kind == FunctionChange::Kind::Removed)
+			continue;
+
+		if (change.kind == FunctionChange::Kind::Identical) {
+			auto names = renames(change.previous, change.current, previous, current);
+			if (carryForward(binInfo, change, names, current))
+				continue;
+		}
+
+		auto [code, config] = decompileFunction(binInfo, change.current.function);
+		if (code == nullptr)
+			continue;
+
+		r_codemeta_free(code);
+		current.record(binInfo, change.current.function.getStart(), config);
+	}
+
+	auto binaryDir = getOutDirPath(getBinaryDirName(binInfo.fetchFilePath()));
+	current.save(Manifest::path(binaryDir));
+	report(changes, binaryDir/"rd_diff.tsv");
+
+	return changes;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file src/r2plugin/r2env.cpp
+ * @brief Environment variables customizing behavior of the plugin.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2env.h"
+
+using namespace retdec::r2plugin;
+
+/**
+ * Empty body for the destructor. The will forbid Environment class
+ * to be instanciated.
+ */
+Environment::~Environment()
+{
+}
+
+/**
+ * Variables recognized by the plugin together with their default values.
+ */
+const std::vector<Environment::Variable> Environment::_variables = {
+	{"DEC_SAVE_DIR", "custom path for output of decompilation to be saved to"},
+	{"DEC_INPUT", "what RetDec decompiles: file on the disk, io view of r2 or slim image of the function", "file"},
+	{"DEC_OUTPUT", "where RetDec writes its output: disk or memory", "disk"},
+	{"DEC_WRITE_IR", "keep LLVM IR and bitcode dumps in memory output mode", "0"},
+	{"DEC_MODULE_CACHE", "save optimized LLVM modules for backend-only decompilation in memory output mode", "0"},
+	{"DEC_LOG_LEVEL", "verbosity of RetDec's log: error, info or verbose", "info"},
+	{"DEC_LOG_LINES", "number of recent log lines kept for each decompilation", "1000"},
+	{"DEC_LOG_DUMP", "write logs of successful decompilations to the disk too", "0"},
+	{"DEC_PROFILE", "pipeline profile used when none is given to the command, auto selects it per function (see pdzp)", "full"},
+	{"DEC_PROFILES_FILE", "JSON file with user-defined pipeline profiles"},
+	{"DEC_TIME_BUDGET", "wall-clock budget of a decompilation in milliseconds, 0 for unlimited", "0"},
+	{"DEC_MEMORY_BUDGET", "memory budget of a decompilation in megabytes, 0 for unlimited", "0"},
+	{"DEC_DEDUP", "share results between functions with identical bytes, in the binary and across binaries", "0"},
+	{"DEC_SIGNATURES", "signature index of static library functions built by pdzl (default: rd_signatures.idx in the output directory)"},
+	{"DEC_PASS_PROFILE", "record time, memory and IR size of each LLVM pass with decompilation results (see pdzr)", "0"},
+	{"DEC_TRACE_FILE", "append spans of requests, their phases and LLVM passes to the file as Chrome trace events"}
+};
+
+const std::vector<Environment::Variable>& Environment::variables()
+{
+	return _variables;
+}
+
+const Environment::Variable* Environment::find(const std::string& name)
+{
+	auto it = std::find_if(_variables.begin(), _variables.end(),
+		[&name](const Variable& v) {
+			return v.name == name;
+		});
+
+	return it == _variables.end() ? nullptr : &*it;
+}
+
+/**
+ * @brief Returns value of the variable or its default value when not set.
+ */
+std::string Environment::get(const std::string& name)
+{
+	auto value = getenv(name.c_str());
+	if (value != nullptr)
+		return value;
+
+	auto var = find(name);
+	return var != nullptr ? var->defaultValue : "";
+}
+
+/**
+ * @brief Checks whether boolean variable is enabled.
+ */
+bool Environment::isEnabled(const std::string& name)
+{
+	auto value = get(name);
+	return !value.empty() && value != "0" && value != "false" && value != "no";
+}
+
+/**
+ * @brief Returns numeric value of the variable.
+ *
+ * @throws DecompilationError when the value is not a number.
+ */
+uint64_t Environment::number(const std::string& name)
+{
+	auto value = get(name);
+	if (value.empty())
+		return 0;
+
+	char* end = nullptr;
+	auto result = std::strtoull(value.c_str(), &end, 0);
+	if (end == nullptr || *end != '\0')
+		throw DecompilationError("invalid $"+name+": not a number: "+value);
+
+	return result;
+}
+
+/**
+ * @brief Sets variable for the rest of the session.
+ *
+ * @throws DecompilationError when the variable is not recognized.
+ */
+void Environment::set(const std::string& name, const std::string& value)
+{
+	if (find(name) == nullptr)
+		throw DecompilationError("unknown environment variable: "+name);
+
+#ifdef _WIN32
+	_putenv_s(name.c_str(), value.c_str());
+#else
+	setenv(name.c_str(), value.c_str(), 1);
+#endif
+}
@@ -0,0 +1,290 @@
+/**
+ * @file src/r2plugin/r2governor.cpp
+ * @brief Time and memory budgets of decompilations.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <r_core.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2metrics.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+/**
+ * Pass inserted between passes of the pipeline by the governor.
+ */
+class CheckpointPass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	CheckpointPass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module& module) override
+	{
+		if (!Governor::checkpoint())
+			return false;
+
+		// Remaining passes get a module without code and finish quickly.
+		for (auto& fnc: module)
+			if (!fnc.isDeclaration())
+				fnc.deleteBody();
+
+		return true;
+	}
+};
+
+char CheckpointPass::ID = 0;
+
+llvm::RegisterPass<CheckpointPass> checkpointRegistration(
+	"r2plugin-checkpoint",
+	"Stops decompilation that exceeded its budget or was cancelled",
+	false,
+	false
+);
+
+}
+
+bool Budget::isLimited() const
+{
+	return milliseconds != 0 || memory != 0;
+}
+
+/**
+ * @brief Returns budget with the lower of non-zero limits.
+ */
+Budget Budget::tightened(const Budget& other) const
+{
+	auto lower = [](uint64_t a, uint64_t b) {
+		if (a == 0 || b == 0)
+			return std::max(a, b);
+
+		return std::min(a, b);
+	};
+
+	return {lower(milliseconds, other.milliseconds), lower(memory, other.memory)};
+}
+
+/**
+ * @brief Returns budget set for the session by $DEC_TIME_BUDGET
+ *        (milliseconds) and $DEC_MEMORY_BUDGET (megabytes).
+ */
+Budget Budget::session()
+{
+	return {
+		Environment::number("DEC_TIME_BUDGET"),
+		Environment::number("DEC_MEMORY_BUDGET") << 20
+	};
+}
+
+const std::string Governor::CheckpointPass = "r2plugin-checkpoint";
+const std::string Governor::FallbackProfile = "fast";
+
+Budget Governor::_budget;
+std::chrono::steady_clock::time_point Governor::_start;
+uint64_t Governor::_baseMemory = 0;
+std::string Governor::_exceeded;
+bool Governor::_consoleBreak = false;
+std::atomic<bool> Governor::_running(false);
+std::atomic<bool> Governor::_cancelRequested(false);
+bool Governor::_cancelled = false;
+std::array<std::atomic<uint64_t>, 3> Governor::_statistics = {};
+
+/**
+ * Empty body for the destructor. The will forbid Governor class
+ * to be instanciated.
+ */
+Governor::~Governor()
+{
+}
+
+Governor::Scope::Scope(const Budget& budget)
+{
+	_budget = budget;
+	_start = std::chrono::steady_clock::now();
+	_baseMemory = budget.memory != 0 ? residentMemory() : 0;
+	_exceeded.clear();
+	_cancelled = false;
+	_cancelRequested = false;
+	_running = true;
+}
+
+Governor::Scope::~Scope()
+{
+	_running = false;
+	_budget = Budget();
+}
+
+Governor::ConsoleBreak::ConsoleBreak()
+{
+	r_cons_break_push(nullptr, nullptr);
+	_consoleBreak = true;
+}
+
+Governor::ConsoleBreak::~ConsoleBreak()
+{
+	_consoleBreak = false;
+	r_cons_break_pop();
+}
+
+/**
+ * @brief Inserts checkpoint after each pass except the last one.
+ *
+ * Checkpoints are inserted into every pipeline so that each decompilation
+ * can be cancelled.
+ */
+void Governor::insertCheckpoints(config::Config& config)
+{
+	auto& passes = config.parameters.llvmPasses;
+	if (passes.empty())
+		return;
+
+	std::vector<std::string> governed;
+	governed.reserve(passes.size()*2);
+	for (auto it = passes.begin(); it != std::prev(passes.end()); ++it) {
+		governed.push_back(*it);
+		governed.push_back(CheckpointPass);
+	}
+	governed.push_back(passes.back());
+
+	passes = std::move(governed);
+}
+
+/**
+ * @brief Checks budget and cancellation of the running decompilation.
+ *
+ * @returns true when the decompilation should stop.
+ */
+bool Governor::checkpoint()
+{
+	if (_cancelled || !_exceeded.empty())
+		return true;
+
+	if (_cancelRequested || (_consoleBreak && r_cons_is_breaked())) {
+		_cancelled = true;
+		return true;
+	}
+
+	if (_budget.milliseconds != 0) {
+		std::chrono::duration<double, std::milli> elapsed =
+			std::chrono::steady_clock::now() - _start;
+
+		if (elapsed.count() > _budget.milliseconds) {
+			std::ostringstream reason;
+			reason << "time budget of " << _budget.milliseconds << " ms exceeded";
+			_exceeded = reason.str();
+			return true;
+		}
+	}
+
+	if (_budget.memory != 0) {
+		auto memory = residentMemory();
+		Metrics::observeMemory(memory);
+		if (memory > _baseMemory && memory - _baseMemory > _budget.memory) {
+			std::ostringstream reason;
+			reason << "memory budget of " << (_budget.memory >> 20) << " MB exceeded";
+			_exceeded = reason.str();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Returns reason why the last decompilation was stopped
+ *        or empty string when it was not.
+ */
+std::string Governor::exceeded()
+{
+	return _exceeded;
+}
+
+/**
+ * @brief Cancels the running decompilation. Does nothing when
+ *        no decompilation is running.
+ *
+ * Can be called from any thread.
+ */
+void Governor::cancel()
+{
+	if (_running)
+		_cancelRequested = true;
+}
+
+/**
+ * @brief Checks whether the last decompilation was cancelled.
+ */
+bool Governor::isCancelled()
+{
+	return _cancelled;
+}
+
+/**
+ * @brief Forgets cancellation of the last decompilation, so that a run
+ *        of several decompilations stops only on its own cancellation.
+ */
+void Governor::forgetCancellation()
+{
+	_cancelled = false;
+}
+
+void Governor::record(Tier tier)
+{
+	_statistics[static_cast<size_t>(tier)]++;
+}
+
+/**
+ * @brief Returns number of decompilations finished by each tier.
+ */
+std::array<uint64_t, 3> Governor::statistics()
+{
+	return {_statistics[0], _statistics[1], _statistics[2]};
+}
+
+/**
+ * @brief Returns resident memory of the process in bytes.
+ */
+uint64_t Governor::residentMemory()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+			reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+		return 0;
+
+	return info.resident_size;
+#else
+	std::ifstream statm("/proc/self/statm");
+	uint64_t size = 0, resident = 0;
+	if (!(statm >> size >> resident))
+		return 0;
+
+	return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
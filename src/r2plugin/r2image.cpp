@@ -0,0 +1,480 @@
+/**
+ * @file src/r2plugin/r2image.cpp
+ * @brief Input images for RetDec created from the state of Radare2.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2image.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+/**
+ * Identifies content of the file by its path, size and time
+ * of the last modification.
+ */
+std::string fileIdentity(const fs::path& file)
+{
+	std::error_code err;
+	std::ostringstream id;
+	id << file.string() << "\t" << fs::file_size(file, err) << "\t"
+		<< fs::last_write_time(file, err).time_since_epoch().count();
+
+	return id.str();
+}
+
+}
+
+std::map<std::string, fs::path> InputImage::_ioImages;
+std::map<std::string, uint64_t> InputImage::_checksums;
+std::map<fs::path, uint64_t> InputImage::_imageChecksums;
+std::pair<fs::path, std::vector<uint8_t>> InputImage::_inMemory;
+
+/**
+ * Empty body for the destructor. The will forbid InputImage class
+ * to be instanciated.
+ */
+InputImage::~InputImage()
+{
+}
+
+/**
+ * @brief Creates image of the input file as it is seen through r2 IO.
+ *
+ * File content held by RBin is used as a base so that headers, imports
+ * and other metadata stay intact. Content of each section is then
+ * replaced by bytes read from its virtual address through the IO layer.
+ * Image thus contains patched bytes, io.cache writes and data of maps
+ * opened over the sections (e.g. unpacked memory dumps).
+ *
+ * Image is built only when the I/O state changed since the last call:
+ * the input file (its size and modification time), opened files, maps
+ * or writes held by io.cache. The state is cheap to obtain, so that
+ * requests do not read the mapped memory until it changes.
+ *
+ * @returns Path to the image.
+ */
+fs::path InputImage::fromIO(const R2Database& binInfo, const fs::path& outDir)
+{
+	auto ioState = binInfo.fetchIOState();
+
+	std::ostringstream state;
+	state << outDir.string() << "\n" << fileIdentity(binInfo.fetchFilePath())
+		<< "\n" << std::hex << CodeCache::checksum(
+			reinterpret_cast<const uint8_t*>(ioState.data()), ioState.size());
+
+	std::error_code err;
+	auto known = _ioImages.find(state.str());
+	if (known != _ioImages.end() && fs::is_regular_file(known->second, err))
+		return known->second;
+
+	auto sections = binInfo.fetchSections();
+
+	std::vector<std::vector<uint8_t>> contents;
+	for (auto& sec: sections) {
+		contents.emplace_back();
+		if (sec.size != 0 && sec.vsize != 0)
+			contents.back() = binInfo.fetchBytes(sec.vaddr, std::min(sec.size, sec.vsize));
+	}
+
+	auto image = binInfo.fetchFileBytes();
+	for (size_t i = 0; i < sections.size(); i++) {
+		auto& sec = sections[i];
+		if (contents[i].empty() || sec.paddr >= image.size())
+			continue;
+
+		auto size = std::min<ut64>(contents[i].size(), image.size()-sec.paddr);
+		memcpy(image.data()+sec.paddr, contents[i].data(), size);
+	}
+
+	auto path = store(image, outDir);
+	_ioImages[state.str()] = path;
+
+	return path;
+}
+
+/**
+ * @brief Returns checksum of the content of the input file.
+ *
+ * Checksum of images created in the session is known without reading
+ * them. Other files are read only when their size or modification time
+ * changed since the checksum was computed.
+ */
+uint64_t InputImage::checksum(const fs::path& file)
+{
+	auto image = _imageChecksums.find(file);
+	if (image != _imageChecksums.end())
+		return image->second;
+
+	auto id = fileIdentity(file);
+	auto known = _checksums.find(id);
+	if (known != _checksums.end())
+		return known->second;
+
+	std::ifstream input(file, std::ios::binary);
+	std::vector<uint8_t> data(
+		(std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	auto sum = CodeCache::checksum(data.data(), data.size());
+	_checksums[id] = sum;
+
+	return sum;
+}
+
+/**
+ * Returns path of the image in the output directory. Name of the image
+ * is derived from its content.
+ */
+fs::path InputImage::imagePath(const std::vector<uint8_t>& image, const fs::path& outDir)
+{
+	auto sum = CodeCache::checksum(image.data(), image.size());
+
+	std::ostringstream name;
+	name << "input-" << std::hex << sum;
+
+	auto path = outDir/name.str();
+	_imageChecksums[path] = sum;
+
+	return path;
+}
+
+/**
+ * Writes image into the output directory unless the same image
+ * was already written.
+ */
+fs::path InputImage::store(const std::vector<uint8_t>& image, const fs::path& outDir)
+{
+	auto path = imagePath(image, outDir);
+
+	std::error_code err;
+	if (fs::is_regular_file(path, err) && fs::file_size(path, err) == image.size())
+		return path;
+
+	write(image, path);
+	return path;
+}
+
+void InputImage::write(const std::vector<uint8_t>& image, const fs::path& path)
+{
+	fs::create_directories(path.parent_path());
+
+	// Write into a temporary file first so that interrupted write
+	// does not leave incomplete image under the final name.
+	auto tmpPath = path;
+	tmpPath += ".tmp";
+
+	std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw DecompilationError("unable to create input image: "+tmpPath.string());
+
+	file.write(reinterpret_cast<const char*>(image.data()), image.size());
+	file.close();
+
+	fs::rename(tmpPath, path);
+}
+
+InputImage::Scope::Scope(const fs::path& input)
+{
+	if (_inMemory.first.empty() || _inMemory.first != input)
+		return;
+
+	write(_inMemory.second, input);
+	_written = input;
+}
+
+InputImage::Scope::~Scope()
+{
+	if (_written.empty())
+		return;
+
+	std::error_code err;
+	fs::remove(_written, err);
+}
+
+namespace {
+
+/**
+ * Appends numbers in the byte order of the target.
+ */
+class ElfBuffer {
+public:
+	ElfBuffer(bool is64, bool bigEndian): _is64(is64), _bigEndian(bigEndian) {}
+
+	void u8(uint8_t v) { _data.push_back(v); }
+	void u16(uint16_t v) { put(v, 2); }
+	void u32(uint32_t v) { put(v, 4); }
+	/// Address sized value (ELF32_Addr/ELF32_Off or ELF64_Addr/ELF64_Off).
+	void addr(uint64_t v) { put(v, _is64 ? 8 : 4); }
+	/// Word sized value (ELF32_Word or ELF64_Xword).
+	void xword(uint64_t v) { put(v, _is64 ? 8 : 4); }
+
+	void bytes(const std::vector<uint8_t>& v) { _data.insert(_data.end(), v.begin(), v.end()); }
+	void align(size_t alignment) { _data.resize((_data.size()+alignment-1)/alignment*alignment); }
+
+	size_t size() const { return _data.size(); }
+	std::vector<uint8_t>& data() { return _data; }
+
+private:
+	void put(uint64_t v, size_t size)
+	{
+		for (size_t i = 0; i < size; i++) {
+			size_t shift = _bigEndian ? (size-1-i)*8 : i*8;
+			_data.push_back((v >> shift) & 0xff);
+		}
+	}
+
+private:
+	bool _is64;
+	bool _bigEndian;
+	std::vector<uint8_t> _data;
+};
+
+const uint16_t EM_386 = 3;
+const uint16_t EM_MIPS = 8;
+const uint16_t EM_PPC = 20;
+const uint16_t EM_PPC64 = 21;
+const uint16_t EM_ARM = 40;
+const uint16_t EM_X86_64 = 62;
+const uint16_t EM_AARCH64 = 183;
+
+const uint32_t EF_ARM_EABI_VER5 = 0x05000000;
+
+}
+
+const R2Address InputImage::PageSize = 0x1000;
+
+/**
+ * @brief Selects ELF machine for the architecture set in Radare2.
+ *
+ * @throws DecompilationError for architectures not supported by RetDec.
+ */
+InputImage::Target InputImage::targetFor(const R2Architecture& arch)
+{
+	bool is64 = arch.bits == 64;
+
+	if (arch.name == "x86")
+		return {is64 ? EM_X86_64 : EM_386, 0, is64, false};
+	if (arch.name == "arm")
+		return is64
+			? Target{EM_AARCH64, 0, true, arch.bigEndian}
+			: Target{EM_ARM, EF_ARM_EABI_VER5, false, arch.bigEndian};
+	if (arch.name == "mips")
+		return {EM_MIPS, 0, false, arch.bigEndian};
+	if (arch.name == "ppc")
+		return {is64 ? EM_PPC64 : EM_PPC, 0, is64, arch.bigEndian};
+
+	throw DecompilationError("slim image is not supported for architecture "+arch.name);
+}
+
+/**
+ * @brief Collects pages needed to decompile the function.
+ *
+ * Image contains the function itself, pages with data referenced
+ * from the function and entry pages of called functions (stubs of
+ * imported functions). Only pages that belong to a section are taken.
+ * Consecutive pages with the same permissions are merged.
+ */
+std::vector<InputImage::Chunk> InputImage::slimChunks(
+		const R2Database& binInfo,
+		const common::Function& fnc)
+{
+	std::set<R2Address> pages;
+	auto addRange = [&pages](R2Address start, R2Address end) {
+		for (auto page = start & ~(PageSize-1); page <= end; page += PageSize)
+			pages.insert(page);
+	};
+
+	addRange(fnc.getStart(), fnc.getEnd());
+	for (auto& ref: binInfo.fetchFunctionReferences(fnc.getStart())) {
+		if (ref.type == "CALL")
+			addRange(ref.to, ref.to);
+		else if (ref.type == "DATA" || ref.type == "STRING")
+			// Data object may cross the page boundary.
+			addRange(ref.to, ref.to + PageSize);
+	}
+
+	auto sections = binInfo.fetchSections();
+
+	std::vector<Chunk> chunks;
+	for (auto page: pages) {
+		auto sec = std::find_if(sections.begin(), sections.end(),
+			[page](const R2Section& s) {
+				return s.vsize != 0 && page < s.vaddr + s.vsize && page + PageSize > s.vaddr;
+			});
+		if (sec == sections.end())
+			continue;
+
+		if (!chunks.empty() && chunks.back().perm == sec->perm
+				&& chunks.back().address + chunks.back().bytes.size() == page) {
+			auto bytes = binInfo.fetchBytes(page, PageSize);
+			chunks.back().bytes.insert(chunks.back().bytes.end(), bytes.begin(), bytes.end());
+			continue;
+		}
+
+		chunks.push_back({page, binInfo.fetchBytes(page, PageSize), sec->perm});
+	}
+
+	return chunks;
+}
+
+/**
+ * @brief Creates ELF executable that contains only the given chunks
+ *        on their original virtual addresses.
+ *
+ * Each chunk is placed into its own loadable segment and section.
+ */
+std::vector<uint8_t> InputImage::createElf(
+		const Target& target,
+		R2Address entry,
+		const std::vector<Chunk>& chunks)
+{
+	const size_t ehdrSize = target.is64 ? 64 : 52;
+	const size_t phdrSize = target.is64 ? 56 : 32;
+	const size_t shdrSize = target.is64 ? 64 : 40;
+
+	// Section names: "", ".slimN"..., ".shstrtab"
+	std::vector<uint8_t> strtab(1, 0);
+	std::vector<uint32_t> nameOffsets;
+	auto addName = [&strtab, &nameOffsets](const std::string& name) {
+		nameOffsets.push_back(strtab.size());
+		strtab.insert(strtab.end(), name.begin(), name.end());
+		strtab.push_back(0);
+	};
+	for (size_t i = 0; i < chunks.size(); i++)
+		addName(".slim"+std::to_string(i));
+	addName(".shstrtab");
+
+	// Data of chunks is placed after headers on page aligned offsets.
+	std::vector<uint64_t> offsets;
+	uint64_t offset = ehdrSize + phdrSize*chunks.size();
+	for (auto& chunk: chunks) {
+		offset = (offset+PageSize-1)/PageSize*PageSize + chunk.address%PageSize;
+		offsets.push_back(offset);
+		offset += chunk.bytes.size();
+	}
+	uint64_t strtabOffset = offset;
+	uint64_t shdrOffset = (strtabOffset + strtab.size() + 7)/8*8;
+
+	ElfBuffer elf(target.is64, target.bigEndian);
+
+	// ELF header.
+	for (uint8_t c: {uint8_t(0x7f), uint8_t('E'), uint8_t('L'), uint8_t('F')})
+		elf.u8(c);
+	elf.u8(target.is64 ? 2 : 1);          // EI_CLASS
+	elf.u8(target.bigEndian ? 2 : 1);     // EI_DATA
+	elf.u8(1);                            // EI_VERSION
+	elf.align(16);
+	elf.u16(2);                           // ET_EXEC
+	elf.u16(target.machine);
+	elf.u32(1);                           // EV_CURRENT
+	elf.addr(entry);
+	elf.addr(chunks.empty() ? 0 : ehdrSize);
+	elf.addr(shdrOffset);
+	elf.u32(target.flags);
+	elf.u16(ehdrSize);
+	elf.u16(phdrSize);
+	elf.u16(chunks.size());
+	elf.u16(shdrSize);
+	elf.u16(chunks.size()+2);
+	elf.u16(chunks.size()+1);
+
+	// Program headers.
+	for (size_t i = 0; i < chunks.size(); i++) {
+		uint32_t flags = 0;
+		flags |= (chunks[i].perm & R_PERM_X) ? 1 : 0;
+		flags |= (chunks[i].perm & R_PERM_W) ? 2 : 0;
+		flags |= (chunks[i].perm & R_PERM_R) ? 4 : 0;
+
+		elf.u32(1);                       // PT_LOAD
+		if (target.is64)
+			elf.u32(flags);
+		elf.addr(offsets[i]);
+		elf.addr(chunks[i].address);
+		elf.addr(chunks[i].address);
+		elf.xword(chunks[i].bytes.size());
+		elf.xword(chunks[i].bytes.size());
+		if (!target.is64)
+			elf.u32(flags);
+		elf.xword(PageSize);
+	}
+
+	// Content.
+	for (size_t i = 0; i < chunks.size(); i++) {
+		elf.data().resize(offsets[i]);
+		elf.bytes(chunks[i].bytes);
+	}
+	elf.bytes(strtab);
+	elf.align(8);
+
+	// Section headers.
+	auto sectionHeader = [&elf](uint32_t name, uint32_t type, uint64_t flags,
+			uint64_t addr, uint64_t offset, uint64_t size, uint64_t align) {
+		elf.u32(name);
+		elf.u32(type);
+		elf.xword(flags);
+		elf.addr(addr);
+		elf.addr(offset);
+		elf.xword(size);
+		elf.u32(0);                       // sh_link
+		elf.u32(0);                       // sh_info
+		elf.xword(align);
+		elf.xword(0);                     // sh_entsize
+	};
+
+	sectionHeader(0, 0, 0, 0, 0, 0, 0);
+	for (size_t i = 0; i < chunks.size(); i++) {
+		uint64_t flags = 0x2;             // SHF_ALLOC
+		flags |= (chunks[i].perm & R_PERM_W) ? 0x1 : 0;
+		flags |= (chunks[i].perm & R_PERM_X) ? 0x4 : 0;
+
+		sectionHeader(nameOffsets[i], 1, flags, chunks[i].address,
+			offsets[i], chunks[i].bytes.size(), 1);
+	}
+	sectionHeader(nameOffsets.back(), 3, 0, 0, strtabOffset, strtab.size(), 1);
+
+	return std::move(elf.data());
+}
+
+/**
+ * @brief Creates minimal image with everything needed to decompile
+ *        the function.
+ *
+ * The image is an ELF executable with the pages selected by slimChunks
+ * on their original virtual addresses. RetDec thus loads and analyzes
+ * only a few pages regardless of the size of the input binary.
+ *
+ * @param inMemory Whether the image should be kept in memory until
+ *                 it is needed by Scope instead of written now. Only
+ *                 the last such image is kept.
+ *
+ * @returns Path to the image.
+ */
+fs::path InputImage::slim(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const fs::path& outDir,
+		bool inMemory)
+{
+	auto target = targetFor(binInfo.fetchArchitecture());
+	auto chunks = slimChunks(binInfo, fnc);
+	if (chunks.empty())
+		throw DecompilationError("function is not located in any section");
+
+	auto image = createElf(target, fnc.getStart(), chunks);
+	if (!inMemory)
+		return store(image, outDir);
+
+	auto path = imagePath(image, outDir);
+	_inMemory = {path, std::move(image)};
+
+	return path;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file src/r2plugin/r2index.cpp
+ * @brief Mapping between positions in decompiled code and addresses.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2index.h"
+
+using namespace retdec::r2plugin;
+
+/**
+ * Builds indexes from annotated code. Annotations are expected to be
+ * produced by R2CGenerator, i.e. offset ranges do not overlap.
+ */
+CodeIndex::CodeIndex(const RCodeMeta& code)
+{
+	auto annotations = static_cast<const RCodeMetaItem*>(code.annotations.a);
+	for (size_t i = 0; i < code.annotations.len; i++) {
+		const RCodeMetaItem& mi = annotations[i];
+		if (mi.type == R_CODEMETA_TYPE_OFFSET)
+			_ranges.push_back({mi.start, mi.end, mi.offset.offset});
+	}
+
+	std::stable_sort(_ranges.begin(), _ranges.end(), [](auto& a, auto& b) {
+		return a.start < b.start;
+	});
+
+	// Lines are split the same way as r_codemeta_line_offsets does.
+	size_t length = code.code ? strlen(code.code) : 0;
+	size_t lineStart = 0;
+	auto range = _ranges.begin();
+	do {
+		const char* next = code.code ? strchr(code.code + lineStart, '\n') : nullptr;
+		size_t lineEnd = next ? (next - code.code) + 1 : length;
+
+		while (range != _ranges.end() && range->end <= lineStart)
+			range++;
+
+		uint64_t address = UT64_MAX;
+		if (range != _ranges.end() && range->start < lineEnd)
+			address = range->address;
+
+		_lines.push_back({lineStart, address});
+		lineStart = lineEnd;
+	} while (lineStart < length);
+
+	for (auto& r: _ranges)
+		_addressLines.emplace_back(r.address, lineAt(r.start));
+
+	std::sort(_addressLines.begin(), _addressLines.end());
+	_addressLines.erase(
+		std::unique(_addressLines.begin(), _addressLines.end()),
+		_addressLines.end());
+}
+
+/**
+ * @brief Returns address that belongs to the position in code.
+ */
+std::optional<uint64_t> CodeIndex::addressAt(uint64_t position) const
+{
+	auto it = std::upper_bound(_ranges.begin(), _ranges.end(), position,
+		[](uint64_t pos, const Range& r) {
+			return pos < r.start;
+		});
+
+	if (it == _ranges.begin())
+		return {};
+
+	it--;
+	if (position >= it->end)
+		return {};
+
+	return it->address;
+}
+
+/**
+ * @brief Returns index of line that contains the position in code.
+ */
+size_t CodeIndex::lineAt(uint64_t position) const
+{
+	auto it = std::upper_bound(_lines.begin(), _lines.end(), position,
+		[](uint64_t pos, const Line& l) {
+			return pos < l.start;
+		});
+
+	return it == _lines.begin() ? 0 : std::distance(_lines.begin(), it) - 1;
+}
+
+/**
+ * @brief Returns lines generated from instruction on the address.
+ *
+ * When the address is not the start of an instruction, lines of
+ * the closest preceding address are returned.
+ */
+std::vector<size_t> CodeIndex::linesOf(uint64_t address) const
+{
+	auto it = std::upper_bound(_addressLines.begin(), _addressLines.end(),
+		std::make_pair(address, UT64_MAX));
+
+	if (it == _addressLines.begin())
+		return {};
+
+	uint64_t found = std::prev(it)->first;
+
+	std::vector<size_t> result;
+	while (it != _addressLines.begin() && std::prev(it)->first == found) {
+		it--;
+		result.push_back(it->second);
+	}
+
+	std::reverse(result.begin(), result.end());
+	return result;
+}
+
+/**
+ * @brief Provides offsets of lines in format of r_codemeta_line_offsets.
+ *
+ * Caller is responsible for freeing returned vector.
+ */
+RVector* CodeIndex::lineOffsets() const
+{
+	RVector *offsets = r_vector_new(sizeof(ut64), nullptr, nullptr);
+	if (offsets == nullptr) {
+		throw DecompilationError("unable to allocate memory");
+	}
+
+	for (auto& line: _lines) {
+		ut64 address = line.address;
+		r_vector_push(offsets, &address);
+	}
+
+	return offsets;
+}
+
+const std::vector<CodeIndex::Range>& CodeIndex::ranges() const
+{
+	return _ranges;
+}
+
+const std::vector<CodeIndex::Line>& CodeIndex::lines() const
+{
+	return _lines;
+}
+
+const std::vector<std::pair<uint64_t, uint64_t>>& CodeIndex::addressLines() const
+{
+	return _addressLines;
+}
+
+/**
+ * Appends packed indexes to the output. Counts of the elements
+ * are not written and must be stored by the caller.
+ */
+void CodeIndex::serialize(std::vector<uint8_t>& out) const
+{
+	auto append = [&out](const void* data, size_t size) {
+		auto bytes = reinterpret_cast<const uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	};
+
+	append(_ranges.data(), _ranges.size() * sizeof(Range));
+	append(_lines.data(), _lines.size() * sizeof(Line));
+	for (auto& [address, line]: _addressLines) {
+		append(&address, sizeof(address));
+		append(&line, sizeof(line));
+	}
+}
+
+/**
+ * Reads indexes written by CodeIndex::serialize.
+ *
+ * @returns Empty optional if size of the data does not match counts.
+ */
+std::optional<CodeIndex> CodeIndex::deserialize(
+		const uint8_t* data,
+		size_t size,
+		size_t rangeCount,
+		size_t lineCount,
+		size_t addressLineCount)
+{
+	size_t rangesSize = rangeCount * sizeof(Range);
+	size_t linesSize = lineCount * sizeof(Line);
+	size_t addressLinesSize = addressLineCount * 2 * sizeof(uint64_t);
+	if (size != rangesSize + linesSize + addressLinesSize)
+		return {};
+
+	CodeIndex index;
+	index._ranges.resize(rangeCount);
+	memcpy(index._ranges.data(), data, rangesSize);
+	data += rangesSize;
+
+	index._lines.resize(lineCount);
+	memcpy(index._lines.data(), data, linesSize);
+	data += linesSize;
+
+	index._addressLines.resize(addressLineCount);
+	for (auto& [address, line]: index._addressLines) {
+		memcpy(&address, data, sizeof(address));
+		memcpy(&line, data + sizeof(address), sizeof(line));
+		data += 2 * sizeof(uint64_t);
+	}
+
+	return index;
+}
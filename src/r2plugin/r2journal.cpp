@@ -0,0 +1,277 @@
+/**
+ * @file src/r2plugin/r2journal.cpp
+ * @brief Journal of bulk decompilation that allows to resume it.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <retdec/utils/io/log.h>
+
+#include "r2plugin/r2journal.h"
+
+using namespace retdec::r2plugin;
+using retdec::utils::io::Log;
+
+/// Single preemption during a long function does not mark it failing.
+const unsigned Journal::MaxUnfinished = 3;
+
+fs::path Journal::path(const fs::path& binaryDir, const std::string& mode)
+{
+	return binaryDir/("rd_journal_"+mode+".tsv");
+}
+
+/**
+ * @brief Loads the journal of the binary with the checksum from the file.
+ *        Missing file or journal of different binary is an empty journal.
+ *
+ * Lines that cannot be parsed (e.g. the last one written when the process
+ * was killed) are ignored.
+ */
+Journal Journal::open(const fs::path& file, uint64_t binary)
+{
+	Journal journal;
+	journal._file = file;
+	journal._binary = binary;
+
+	std::ifstream input(file);
+	std::string line;
+	if (!std::getline(input, line) || line != binaryLine(binary)) {
+		if (input)
+			Log::info() << "binary changed since the last run, starting over" << std::endl;
+
+		input.close();
+		journal.clear();
+		return journal;
+	}
+
+	while (std::getline(input, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream columns(line);
+		std::string start, status, seconds;
+		if (!std::getline(columns, start, '\t')
+				|| !std::getline(columns, status, '\t')
+				|| !std::getline(columns, seconds, '\t'))
+			continue;
+
+		R2Address address;
+		double duration;
+		try {
+			address = std::stoull(start, nullptr, 16);
+			duration = std::stod(seconds);
+		}
+		catch (const std::exception&) {
+			continue;
+		}
+
+		auto& entry = journal._entries[address];
+		if (status == statusName(Status::Started)) {
+			entry.unfinished++;
+		}
+		else if (status == statusName(Status::Done) || status == statusName(Status::Failed)) {
+			entry.status = status == statusName(Status::Done) ? Status::Done : Status::Failed;
+			entry.unfinished = 0;
+			entry.seconds = duration;
+		}
+		else if (status == statusName(Status::Aborted)) {
+			entry.status = Status::Started;
+			entry.unfinished = 0;
+		}
+	}
+
+	// Next event must not be glued to a line cut off by killing the process.
+	std::ifstream last(file, std::ios::binary | std::ios::ate);
+	if (last && last.tellg() > 0) {
+		last.seekg(-1, std::ios::end);
+		if (last.get() != '\n')
+			std::ofstream(file, std::ios::app) << "\n";
+	}
+
+	return journal;
+}
+
+/**
+ * @brief Forgets all records and starts the file again. New journal starts
+ *        with the binary it belongs to, before workers append to it.
+ */
+void Journal::clear()
+{
+	std::error_code err;
+	fs::remove(_file, err);
+	_entries.clear();
+
+	appendLine(binaryLine(_binary) + "\n");
+}
+
+/**
+ * @brief Records attempt that was stopped on purpose (cancelled, or out
+ *        of budget). The function is neither done nor known to fail.
+ */
+void Journal::abort(const common::Function& fnc, double seconds)
+{
+	auto& entry = _entries[fnc.getStart()];
+	entry.status = Status::Started;
+	entry.unfinished = 0;
+	append(fnc, Status::Aborted, seconds);
+}
+
+/**
+ * @brief Counts attempt that did not finish because the process decompiling
+ *        the function crashed. Its start is already in the file.
+ */
+void Journal::abandon(const common::Function& fnc)
+{
+	_entries[fnc.getStart()].unfinished++;
+}
+
+void Journal::start(const common::Function& fnc)
+{
+	_entries[fnc.getStart()].unfinished++;
+	append(fnc, Status::Started, 0);
+}
+
+void Journal::finish(const common::Function& fnc, bool success, double seconds)
+{
+	auto& entry = _entries[fnc.getStart()];
+	entry.status = success ? Status::Done : Status::Failed;
+	entry.unfinished = 0;
+	entry.seconds = seconds;
+	append(fnc, entry.status, seconds);
+}
+
+bool Journal::isDone(R2Address start) const
+{
+	auto it = _entries.find(start);
+	return it != _entries.end() && it->second.status == Status::Done;
+}
+
+bool Journal::isFailing(R2Address start) const
+{
+	auto it = _entries.find(start);
+	return it != _entries.end() && (it->second.status == Status::Failed
+			|| it->second.unfinished >= MaxUnfinished);
+}
+
+size_t Journal::done() const
+{
+	size_t count = 0;
+	for (auto& [start, _]: _entries)
+		count += isDone(start);
+
+	return count;
+}
+
+size_t Journal::failing() const
+{
+	size_t count = 0;
+	for (auto& [start, _]: _entries)
+		count += isFailing(start);
+
+	return count;
+}
+
+const fs::path& Journal::file() const
+{
+	return _file;
+}
+
+/**
+ * Appends the event as one line. The file is opened for each event so
+ * that forked workers append their lines in one piece.
+ */
+void Journal::append(const common::Function& fnc, Status status, double seconds)
+{
+	std::ostringstream line;
+	line << std::hex << fnc.getStart().getValue() << std::dec << "\t"
+		<< statusName(status) << "\t"
+		<< std::fixed << std::setprecision(3) << seconds << "\t"
+		<< fnc.getName() << "\n";
+
+	appendLine(line.str());
+}
+
+void Journal::appendLine(const std::string& line)
+{
+	std::error_code err;
+	fs::create_directories(_file.parent_path(), err);
+
+	std::ofstream output(_file, std::ios::app);
+	if (!output || !(output << line << std::flush))
+		Log::error() << Log::Warning << "unable to write journal " << _file.string() << std::endl;
+}
+
+std::string Journal::binaryLine(uint64_t binary)
+{
+	std::ostringstream line;
+	line << "# binary\t" << std::hex << binary;
+	return line.str();
+}
+
+std::string Journal::statusName(Status status)
+{
+	switch (status) {
+	case Status::Started: return "started";
+	case Status::Done: return "done";
+	case Status::Failed: return "failed";
+	case Status::Aborted: return "aborted";
+	}
+
+	return "";
+}
+
+ProgressReporter::ProgressReporter(size_t total, std::chrono::seconds interval):
+	_total(total),
+	_interval(interval),
+	_start(std::chrono::steady_clock::now()),
+	_last(_start)
+{
+}
+
+/**
+ * @brief Logs processed and failed functions of this run with elapsed and
+ *        remaining time estimated from the rate of this run.
+ */
+void ProgressReporter::update(size_t processed, size_t failed, bool force)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (!force && now - _last < _interval)
+		return;
+
+	_last = now;
+	std::chrono::duration<double> elapsed = now - _start;
+
+	std::ostringstream line;
+	line << "progress: " << processed << "/" << _total;
+	if (_total != 0)
+		line << " (" << processed * 100 / _total << "%)";
+
+	line << ", failed: " << failed
+		<< ", elapsed: " << formatDuration(elapsed.count()) << ", ETA: ";
+
+	if (processed == 0)
+		line << "unknown";
+	else
+		line << formatDuration(elapsed.count() / processed * (_total - std::min(processed, _total)));
+
+	Log::info() << line.str() << std::endl;
+}
+
+/**
+ * @brief Formats seconds as h:mm:ss.
+ */
+std::string ProgressReporter::formatDuration(double seconds)
+{
+	auto total = uint64_t(seconds + 0.5);
+
+	std::ostringstream out;
+	out << total / 3600 << ":" << std::setfill('0')
+		<< std::setw(2) << total / 60 % 60 << ":"
+		<< std::setw(2) << total % 60;
+
+	return out.str();
+}
@@ -0,0 +1,203 @@
+/**
+ * @file src/r2plugin/r2log.cpp
+ * @brief In-memory logging of RetDec decompilation jobs.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <retdec/utils/io/log.h>
+
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2log.h"
+
+using namespace retdec::r2plugin;
+using namespace retdec::utils::io;
+
+namespace {
+
+/**
+ * Pass inserted in front of the pipeline by LogGuard.
+ */
+class InstallLogsPass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	InstallLogsPass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module&) override
+	{
+		LogGuard::reinstall();
+		return false;
+	}
+};
+
+char InstallLogsPass::ID = 0;
+
+llvm::RegisterPass<InstallLogsPass> installLogsRegistration(
+	"r2plugin-install-logs",
+	"Installs in-memory loggers replaced by RetDec",
+	false,
+	false
+);
+
+}
+
+const std::string LogGuard::InstallPass = "r2plugin-install-logs";
+
+LogGuard* LogGuard::_active = nullptr;
+
+LogBuffer::LogBuffer(size_t capacity):
+	_capacity(capacity)
+{
+}
+
+const std::deque<std::string>& LogBuffer::lines() const
+{
+	return _lines;
+}
+
+/**
+ * Writes kept lines (including unfinished one) into the file.
+ */
+void LogBuffer::dump(const fs::path& path) const
+{
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	for (auto& line: _lines)
+		file << line << '\n';
+
+	if (!_current.empty())
+		file << _current << '\n';
+}
+
+void LogBuffer::pushLine()
+{
+	_lines.push_back(std::move(_current));
+	_current.clear();
+
+	while (_lines.size() > _capacity)
+		_lines.pop_front();
+}
+
+int LogBuffer::overflow(int c)
+{
+	if (c == traits_type::eof())
+		return traits_type::not_eof(c);
+
+	if (c == '\n')
+		pushLine();
+	else
+		_current.push_back(traits_type::to_char_type(c));
+
+	return c;
+}
+
+std::streamsize LogBuffer::xsputn(const char* s, std::streamsize n)
+{
+	for (std::streamsize i = 0; i < n; i++)
+		overflow(traits_type::to_int_type(s[i]));
+
+	return n;
+}
+
+/**
+ * Creates buffers with capacity given by DEC_LOG_LINES and installs
+ * them as RetDec's loggers. Info messages are kept only with
+ * DEC_LOG_LEVEL info or verbose.
+ */
+LogGuard::LogGuard(const fs::path& dumpDir):
+	_dumpDir(dumpDir),
+	_exceptions(std::uncaught_exceptions()),
+	_infoEnabled(true),
+	_infoBuffer(Environment::number("DEC_LOG_LINES")),
+	_errorBuffer(Environment::number("DEC_LOG_LINES")),
+	_infoStream(&_infoBuffer),
+	_errorStream(&_errorBuffer)
+{
+	auto level = Environment::get("DEC_LOG_LEVEL");
+	if (level != "error" && level != "info" && level != "verbose")
+		throw DecompilationError("invalid $DEC_LOG_LEVEL: "+level);
+
+	_infoEnabled = level != "error";
+	_active = this;
+	install();
+}
+
+/**
+ * Restores console loggers. Buffers are dumped when the job failed
+ * or when DEC_LOG_DUMP is set.
+ */
+LogGuard::~LogGuard()
+{
+	_active = nullptr;
+	Log::set(Log::Type::Info, Logger::Ptr(new Logger(std::cout)));
+	Log::set(Log::Type::Debug, Logger::Ptr(new Logger(std::cout)));
+	Log::set(Log::Type::Error, Logger::Ptr(new Logger(std::cerr)));
+
+	bool failed = std::uncaught_exceptions() > _exceptions;
+	if (failed || Environment::isEnabled("DEC_LOG_DUMP")) {
+		try {
+			dump();
+		}
+		catch (...) {
+			// Destructor must not throw. Dump is best effort.
+		}
+	}
+}
+
+/**
+ * Installs buffers as loggers of all types. Warnings are written
+ * by the error logger, debug messages are kept with info ones.
+ */
+void LogGuard::install()
+{
+	Log::set(Log::Type::Info, Logger::Ptr(new Logger(_infoStream, _infoEnabled)));
+	Log::set(Log::Type::Debug, Logger::Ptr(new Logger(_infoStream, isVerbose())));
+	Log::set(Log::Type::Error, Logger::Ptr(new Logger(_errorStream)));
+}
+
+/**
+ * @brief Inserts pass that installs buffers of the active guard
+ *        in front of the pipeline.
+ *
+ * Must be called after the pipeline is instrumented so that
+ * the pass is not profiled.
+ */
+void LogGuard::insertPass(config::Config& config)
+{
+	auto& passes = config.parameters.llvmPasses;
+	passes.insert(passes.begin(), InstallPass);
+}
+
+/**
+ * @brief Installs buffers of the active guard again after RetDec
+ *        replaced them.
+ */
+void LogGuard::reinstall()
+{
+	if (_active != nullptr)
+		_active->install();
+}
+
+/**
+ * Writes buffered logs into rd_out.log and rd_err.log.
+ */
+void LogGuard::dump() const
+{
+	fs::create_directories(_dumpDir);
+	_infoBuffer.dump(_dumpDir/"rd_out.log");
+	_errorBuffer.dump(_dumpDir/"rd_err.log");
+}
+
+/**
+ * @brief Checks whether RetDec should produce verbose output.
+ */
+bool LogGuard::isVerbose()
+{
+	return Environment::get("DEC_LOG_LEVEL") == "verbose";
+}
@@ -0,0 +1,281 @@
+/**
+ * @file src/r2plugin/r2metrics.cpp
+ * @brief Latency histograms and counters of the decompiler.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2metrics.h"
+#include "r2plugin/r2passprof.h"
+
+using namespace retdec::r2plugin;
+
+void Histogram::record(uint64_t value)
+{
+	_buckets[bucket(value)]++;
+	_min = _count == 0 ? value : std::min(_min, value);
+	_max = std::max(_max, value);
+	_sum += value;
+	_count++;
+}
+
+void Histogram::reset()
+{
+	*this = Histogram();
+}
+
+uint64_t Histogram::count() const
+{
+	return _count;
+}
+
+uint64_t Histogram::min() const
+{
+	return _min;
+}
+
+uint64_t Histogram::max() const
+{
+	return _max;
+}
+
+double Histogram::mean() const
+{
+	return _count != 0 ? _sum/_count : 0;
+}
+
+/**
+ * @brief Returns highest value equivalent to the value at nearest rank
+ *        of the percentile (0 to 1).
+ */
+uint64_t Histogram::percentile(double p) const
+{
+	if (_count == 0)
+		return 0;
+
+	auto rank = std::max<uint64_t>(uint64_t(std::ceil(p * _count)), 1);
+
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < Buckets; i++) {
+		seen += _buckets[i];
+		if (seen >= rank)
+			return std::min(highestValue(i), _max);
+	}
+
+	return _max;
+}
+
+unsigned Histogram::bucket(uint64_t value)
+{
+	if (value < SubBuckets)
+		return unsigned(value);
+
+	unsigned msb = SubBucketBits;
+	while (msb < 63 && (value >> (msb+1)) != 0)
+		msb++;
+
+	// Value shifted by this is in [SubBuckets/2, SubBuckets).
+	unsigned shift = msb - (SubBucketBits-1);
+	return SubBuckets + (shift-1)*(SubBuckets/2) + unsigned(value >> shift) - SubBuckets/2;
+}
+
+uint64_t Histogram::highestValue(unsigned bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket;
+
+	unsigned shift = (bucket - SubBuckets)/(SubBuckets/2) + 1;
+	uint64_t top = (bucket - SubBuckets)%(SubBuckets/2) + SubBuckets/2;
+
+	// Wraps to the highest 64-bit value for the last bucket.
+	return ((top+1) << shift) - 1;
+}
+
+std::array<std::atomic<uint64_t>, size_t(Metrics::Counter::Count)> Metrics::_counters = {};
+std::array<std::atomic<uint64_t>, size_t(Metrics::CacheTier::Count)> Metrics::_hits = {};
+std::array<std::atomic<uint64_t>, size_t(Metrics::CacheTier::Count)> Metrics::_misses = {};
+std::atomic<uint64_t> Metrics::_peakMemory(0);
+
+std::mutex Metrics::_mutex;
+std::array<Histogram, size_t(Stats::Phase::Count)> Metrics::_histograms;
+
+/**
+ * Empty body for the destructor. The will forbid Metrics class
+ * to be instanciated.
+ */
+Metrics::~Metrics()
+{
+}
+
+void Metrics::increment(Counter counter, uint64_t value)
+{
+	_counters[size_t(counter)] += value;
+}
+
+void Metrics::cacheLookup(CacheTier tier, bool hit)
+{
+	if (hit)
+		_hits[size_t(tier)]++;
+	else
+		_misses[size_t(tier)]++;
+}
+
+/**
+ * @brief Records duration of the phase. Resident memory is sampled
+ *        at the end of each request.
+ */
+void Metrics::observe(Stats::Phase phase, double milliseconds)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_histograms[size_t(phase)].record(uint64_t(std::llround(milliseconds*1000)));
+	}
+
+	if (phase == Stats::Phase::Total)
+		observeMemory(Governor::residentMemory());
+}
+
+void Metrics::observeMemory(uint64_t bytes)
+{
+	auto peak = _peakMemory.load();
+	while (bytes > peak && !_peakMemory.compare_exchange_weak(peak, bytes));
+}
+
+std::string Metrics::counterName(Counter counter)
+{
+	switch (counter) {
+	case Counter::Requests:
+		return "requests";
+	case Counter::Failures:
+		return "failures";
+	case Counter::Timeouts:
+		return "timeouts";
+	case Counter::Cancellations:
+		return "cancellations";
+	case Counter::BytesRead:
+		return "bytes_read";
+	case Counter::BytesWritten:
+		return "bytes_written";
+	case Counter::Count:
+		break;
+	}
+
+	return "";
+}
+
+std::string Metrics::tierName(CacheTier tier)
+{
+	switch (tier) {
+	case CacheTier::Memory:
+		return "memory";
+	case CacheTier::Disk:
+		return "disk";
+	case CacheTier::Module:
+		return "module";
+	case CacheTier::Dedup:
+		return "dedup";
+	case CacheTier::Count:
+		break;
+	}
+
+	return "";
+}
+
+/**
+ * @brief Dumps counters, cache lookups, memory and histograms of phases
+ *        (in microseconds) as JSON object.
+ */
+std::string Metrics::toJson()
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+
+	writer.Key("counters");
+	writer.StartObject();
+	for (size_t i = 0; i < size_t(Counter::Count); i++) {
+		writer.Key(counterName(Counter(i)).c_str());
+		writer.Uint64(_counters[i]);
+	}
+	writer.EndObject();
+
+	writer.Key("cache");
+	writer.StartObject();
+	for (size_t i = 0; i < size_t(CacheTier::Count); i++) {
+		writer.Key(tierName(CacheTier(i)).c_str());
+		writer.StartObject();
+		writer.Key("hits");
+		writer.Uint64(_hits[i]);
+		writer.Key("misses");
+		writer.Uint64(_misses[i]);
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	// High-water mark of the process is not affected by reset.
+	writer.Key("memory");
+	writer.StartObject();
+	writer.Key("peak_bytes");
+	writer.Uint64(_peakMemory);
+	writer.Key("process_peak_bytes");
+	writer.Uint64(PassProfiler::peakResidentMemory());
+	writer.EndObject();
+
+	writer.Key("latency_us");
+	writer.StartObject();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (size_t i = 0; i < size_t(Stats::Phase::Count); i++) {
+			auto& histogram = _histograms[i];
+
+			writer.Key(Stats::phaseName(Stats::Phase(i)).c_str());
+			writer.StartObject();
+			writer.Key("count");
+			writer.Uint64(histogram.count());
+			writer.Key("min");
+			writer.Uint64(histogram.min());
+			writer.Key("mean");
+			writer.Double(histogram.mean());
+			writer.Key("p50");
+			writer.Uint64(histogram.percentile(0.50));
+			writer.Key("p90");
+			writer.Uint64(histogram.percentile(0.90));
+			writer.Key("p99");
+			writer.Uint64(histogram.percentile(0.99));
+			writer.Key("p999");
+			writer.Uint64(histogram.percentile(0.999));
+			writer.Key("max");
+			writer.Uint64(histogram.max());
+			writer.EndObject();
+		}
+	}
+	writer.EndObject();
+
+	writer.EndObject();
+
+	return buffer.GetString();
+}
+
+void Metrics::reset()
+{
+	for (auto& counter: _counters)
+		counter = 0;
+
+	for (size_t i = 0; i < size_t(CacheTier::Count); i++) {
+		_hits[i] = 0;
+		_misses[i] = 0;
+	}
+
+	_peakMemory = 0;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (auto& histogram: _histograms)
+		histogram.reset();
+}
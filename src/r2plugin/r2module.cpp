@@ -0,0 +1,534 @@
+/**
+ * @file src/r2plugin/r2module.cpp
+ * @brief Cache of optimized LLVM modules for backend-only decompilation.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2module.h"
+#include "r2plugin/r2retdec.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+/**
+ * Writes the module into ModuleCache::savePath.
+ *
+ * Module of decompilation stopped by the governor has no function
+ * bodies and is not written.
+ */
+class SaveModulePass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	SaveModulePass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module& module) override
+	{
+		auto& path = ModuleCache::savePath();
+		if (path.empty() || Governor::isCancelled() || !Governor::exceeded().empty())
+			return false;
+
+		std::error_code err;
+		fs::create_directories(path.parent_path(), err);
+
+		llvm::raw_fd_ostream out(path.string(), err);
+		if (err)
+			return false;
+
+		llvm::WriteBitcodeToFile(module, out);
+		return false;
+	}
+};
+
+/**
+ * Links the module from ModuleCache::loadPath into the module
+ * that is empty at the time.
+ */
+class LoadModulePass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	LoadModulePass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module& module) override
+	{
+		auto buffer = llvm::MemoryBuffer::getFile(ModuleCache::loadPath().string());
+		if (!buffer) {
+			ModuleCache::fail();
+			return false;
+		}
+
+		auto loaded = llvm::parseBitcodeFile(buffer.get()->getMemBufferRef(), module.getContext());
+		if (!loaded) {
+			llvm::consumeError(loaded.takeError());
+			ModuleCache::fail();
+			return false;
+		}
+
+		if (llvm::Linker::linkModules(module, std::move(loaded.get())))
+			ModuleCache::fail();
+
+		return true;
+	}
+};
+
+/**
+ * Renames functions and global variables of the loaded module.
+ */
+class RenamePass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	RenamePass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module& module) override
+	{
+		// Objects are renamed in two steps so that swapped names
+		// are not uniqued by LLVM.
+		std::vector<std::pair<llvm::GlobalValue*, std::string>> renamed;
+		for (auto& [from, to]: ModuleCache::renames()) {
+			llvm::GlobalValue* value = module.getNamedValue(from);
+			if (value == nullptr)
+				continue;
+
+			value->setName("r2plugin.rename."+std::to_string(renamed.size()));
+			renamed.emplace_back(value, to);
+		}
+
+		for (auto& [value, name]: renamed)
+			value->setName(name);
+
+		return !renamed.empty();
+	}
+};
+
+char SaveModulePass::ID = 0;
+char LoadModulePass::ID = 0;
+char RenamePass::ID = 0;
+
+llvm::RegisterPass<SaveModulePass> saveRegistration(
+	"r2plugin-save-module",
+	"Saves optimized module for backend-only decompilation",
+	false,
+	false
+);
+
+llvm::RegisterPass<LoadModulePass> loadRegistration(
+	"r2plugin-load-module",
+	"Loads optimized module of previous decompilation",
+	false,
+	false
+);
+
+llvm::RegisterPass<RenamePass> renameRegistration(
+	"r2plugin-rename",
+	"Renames functions and global variables of the loaded module",
+	false,
+	false
+);
+
+std::string serialize(const rapidjson::Value& value)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	value.Accept(writer);
+
+	return buffer.GetString();
+}
+
+void removeNames(rapidjson::Value& object)
+{
+	for (auto name: {"name", "realName", "demangledName", "declarationStr"})
+		object.RemoveMember(name);
+}
+
+}
+
+const std::string ModuleCache::SavePass = "r2plugin-save-module";
+const std::string ModuleCache::LoadPass = "r2plugin-load-module";
+const std::string ModuleCache::RenamePass = "r2plugin-rename";
+
+fs::path ModuleCache::_loadPath;
+fs::path ModuleCache::_savePath;
+std::vector<std::pair<std::string, std::string>> ModuleCache::_renames;
+std::map<std::string, std::string> ModuleCache::_names;
+std::map<std::string, ModuleCache::WholeModule> ModuleCache::_wholeModules;
+bool ModuleCache::_failed = false;
+
+/**
+ * Empty body for the destructor. The will forbid ModuleCache class
+ * to be instanciated.
+ */
+ModuleCache::~ModuleCache()
+{
+}
+
+fs::path ModuleCache::modulePath(const config::Config& config)
+{
+	return fs::path(config.parameters.getOutputFile()).replace_filename("rd_module.bc");
+}
+
+fs::path ModuleCache::keyPath(const config::Config& config)
+{
+	return fs::path(config.parameters.getOutputFile()).replace_filename("rd_module.key");
+}
+
+fs::path ModuleCache::namesPath(const config::Config& config)
+{
+	return fs::path(config.parameters.getOutputFile()).replace_filename("rd_module.names");
+}
+
+/**
+ * @brief Hashes the config without names of all objects.
+ *
+ * Renames are applied to the saved module and reflected by the backend
+ * alone. Types are kept, the saved module is typed by the front end and
+ * a retyped object requires the whole pipeline.
+ */
+std::string ModuleCache::structuralKey(const config::Config& config)
+{
+	rapidjson::Document d;
+	d.Parse(config.generateJsonString().c_str());
+
+	std::vector<std::string> parts;
+
+	// Input and pipeline are the only decompilation parameters
+	// that change the module.
+	auto& params = d["decompParams"];
+	if (params.HasMember("inputFile"))
+		parts.push_back(serialize(params["inputFile"]));
+	if (params.HasMember("llvmPasses"))
+		parts.push_back(serialize(params["llvmPasses"]));
+
+	// Objects are sorted by name in the config. Parts are sorted
+	// so that the key does not depend on the order.
+	std::vector<std::string> objects;
+	if (d.HasMember("functions") && d["functions"].IsArray()) {
+		for (auto& fnc: d["functions"].GetArray()) {
+			removeNames(fnc);
+			if (fnc.HasMember("locals") && fnc["locals"].IsArray())
+				for (auto& local: fnc["locals"].GetArray())
+					removeNames(local);
+			if (fnc.HasMember("parameters") && fnc["parameters"].IsArray())
+				for (auto& param: fnc["parameters"].GetArray())
+					removeNames(param);
+
+			objects.push_back(serialize(fnc));
+		}
+	}
+
+	if (d.HasMember("globals") && d["globals"].IsArray()) {
+		for (auto& global: d["globals"].GetArray()) {
+			removeNames(global);
+			objects.push_back(serialize(global));
+		}
+	}
+
+	std::sort(objects.begin(), objects.end());
+	parts.insert(parts.end(), objects.begin(), objects.end());
+
+	std::string key;
+	for (auto& part: parts)
+		key += part + "\n";
+
+	std::ostringstream hash;
+	hash << std::hex << CodeCache::checksum(
+		reinterpret_cast<const uint8_t*>(key.data()), key.size());
+
+	return hash.str();
+}
+
+/**
+ * @brief Hashes input and pipeline of the config.
+ *
+ * Modules created from the same key differ only by analyzed functions.
+ */
+std::string ModuleCache::sessionKey(const config::Config& config)
+{
+	std::string key = config.parameters.getInputFile() + "\n";
+	for (auto& pass: config.parameters.llvmPasses)
+		key += pass + "\n";
+
+	std::ostringstream hash;
+	hash << std::hex << CodeCache::checksum(
+		reinterpret_cast<const uint8_t*>(key.data()), key.size());
+
+	return hash.str();
+}
+
+/**
+ * @brief Names of functions and global variables by their addresses.
+ */
+std::map<std::string, std::string> ModuleCache::namesByAddress(const config::Config& config)
+{
+	std::map<std::string, std::string> names;
+
+	for (auto& fnc: config.functions) {
+		std::ostringstream address;
+		address << "f" << std::hex << fnc.getStart().getValue();
+		names[address.str()] = fnc.getName();
+	}
+
+	for (auto& global: config.globals) {
+		std::ostringstream address;
+		address << "g" << std::hex << global.getStorage().getAddress().getValue();
+		names[address.str()] = global.getName();
+	}
+
+	return names;
+}
+
+/**
+ * @brief Replaces the pipeline by load of the saved module, rename
+ *        of its objects and the backend.
+ *
+ * Objects unknown when the module was created keep names given
+ * by RetDec. Those are derived from their addresses.
+ *
+ * @param select Whether functions outside of selected ranges should
+ *               be removed from the loaded module.
+ */
+void ModuleCache::useSavedModule(
+		config::Config& config,
+		const fs::path& module,
+		const std::map<std::string, std::string>& oldNames,
+		bool select)
+{
+	for (auto& [address, name]: namesByAddress(config)) {
+		auto old = oldNames.find(address);
+		std::string oldName = old != oldNames.end()
+			? old->second
+			: (address[0] == 'f' ? "function_" : "global_var_") + address.substr(1);
+
+		if (oldName != name)
+			_renames.emplace_back(oldName, name);
+	}
+
+	_loadPath = module;
+
+	auto& passes = config.parameters.llvmPasses;
+	auto backend = passes.empty() ? "retdec-llvmir2hll" : passes.back();
+
+	passes = {"retdec-provider-init", LoadPass, RenamePass};
+	if (select)
+		passes.push_back("retdec-select-fncs");
+	passes.push_back(backend);
+}
+
+void ModuleCache::reset()
+{
+	_failed = false;
+	_loadPath.clear();
+	_savePath.clear();
+	_renames.clear();
+	_names.clear();
+}
+
+/**
+ * @brief Checks whether modules are saved for decompilations with the config.
+ *
+ * Module of whole-binary decompilation is always saved, single functions
+ * of the session are emitted from it. Modules of other decompilations
+ * are saved only with the cache and not in memory output mode unless
+ * user opted in.
+ */
+bool ModuleCache::isEnabled(const config::Config& config, bool useCache)
+{
+	if (isWhole(config))
+		return true;
+
+	return useCache && (!hasInMemoryOutput(config) || Environment::isEnabled("DEC_MODULE_CACHE"));
+}
+
+bool ModuleCache::isWhole(const config::Config& config)
+{
+	return config.parameters.selectedRanges.empty();
+}
+
+/**
+ * @brief Replaces the pipeline by the backend-only one when the module
+ *        saved for the same structural key exists.
+ *
+ * @returns true when the pipeline was replaced.
+ */
+bool ModuleCache::prepareBackendOnly(config::Config& config, const std::string& key)
+{
+	reset();
+
+	std::ifstream keyFile(keyPath(config));
+	std::string savedKey;
+	if (!(keyFile >> savedKey) || savedKey != key || !fs::is_regular_file(modulePath(config)))
+		return false;
+
+	// Each line of the names file is: <kind><hex address>\t<name>
+	std::map<std::string, std::string> oldNames;
+	std::ifstream namesFile(namesPath(config));
+	std::string line;
+	while (std::getline(namesFile, line)) {
+		auto tab = line.find('\t');
+		if (tab != std::string::npos)
+			oldNames[line.substr(0, tab)] = line.substr(tab+1);
+	}
+
+	useSavedModule(config, modulePath(config), oldNames, false);
+	return true;
+}
+
+/**
+ * @brief Replaces the pipeline by emission of the selected functions
+ *        from the module of whole-binary decompilation of the session.
+ *
+ * Module is used only when types and prototypes did not change since
+ * the whole binary was decompiled.
+ *
+ * @returns true when such module exists for the same input, pipeline
+ *          and structural key.
+ */
+bool ModuleCache::prepareFromWhole(
+		config::Config& config,
+		const std::string& key,
+		const std::string& sessionKey)
+{
+	reset();
+
+	if (config.parameters.selectedRanges.empty())
+		return false;
+
+	auto whole = _wholeModules.find(sessionKey);
+	if (whole == _wholeModules.end() || whole->second.key != key
+			|| !fs::is_regular_file(whole->second.module))
+		return false;
+
+	useSavedModule(config, whole->second.module, whole->second.names, true);
+	return true;
+}
+
+/**
+ * @brief Inserts save of the module before the last pass of the pipeline
+ *        (retdec-llvmir2hll).
+ *
+ * Key of the previously saved module is removed and the module is not
+ * used for the session anymore, as the module is overwritten even when
+ * the decompilation does not succeed.
+ *
+ * @param save Whether the module should be saved, see isEnabled.
+ *             The pipeline is left intact otherwise.
+ */
+void ModuleCache::prepareFull(config::Config& config, bool save)
+{
+	reset();
+	if (!save)
+		return;
+
+	_savePath = modulePath(config);
+	_names = namesByAddress(config);
+
+	std::error_code err;
+	fs::remove(keyPath(config), err);
+
+	for (auto it = _wholeModules.begin(); it != _wholeModules.end();) {
+		if (it->second.module == _savePath)
+			it = _wholeModules.erase(it);
+		else
+			++it;
+	}
+
+	auto& passes = config.parameters.llvmPasses;
+	if (!passes.empty())
+		passes.insert(std::prev(passes.end()), SavePass);
+}
+
+/**
+ * @brief Sets structural key under which the module of whole-binary
+ *        decompilation of the session is used.
+ *
+ * Whole-binary decompilation imports its functions into r2, which changes
+ * the config of subsequent requests. The key is then taken from the config
+ * that reflects r2 after the import.
+ */
+void ModuleCache::rekeyWhole(const std::string& sessionKey, const std::string& key)
+{
+	auto whole = _wholeModules.find(sessionKey);
+	if (whole != _wholeModules.end())
+		whole->second.key = key;
+}
+
+/**
+ * @brief Makes the saved module usable for subsequent requests.
+ *
+ * Names the module was created with are those of the config
+ * at the time of prepareFull. Module of whole-binary decompilation
+ * is also registered for single-function requests of the session.
+ */
+void ModuleCache::commit(
+		const config::Config& config,
+		const std::string& key,
+		const std::string& sessionKey)
+{
+	if (_savePath.empty())
+		return;
+
+	if (isWhole(config))
+		_wholeModules[sessionKey] = {_savePath, _names, key};
+
+	_savePath.clear();
+
+	std::ofstream names(namesPath(config), std::ios::trunc);
+	for (auto& [address, name]: _names)
+		names << address << "\t" << name << "\n";
+
+	std::ofstream keyFile(keyPath(config), std::ios::trunc);
+	keyFile << key;
+}
+
+void ModuleCache::invalidate(const config::Config& config)
+{
+	std::error_code err;
+	fs::remove(keyPath(config), err);
+	fs::remove(modulePath(config), err);
+}
+
+bool ModuleCache::failed()
+{
+	return _failed;
+}
+
+const fs::path& ModuleCache::loadPath()
+{
+	return _loadPath;
+}
+
+const fs::path& ModuleCache::savePath()
+{
+	return _savePath;
+}
+
+const std::vector<std::pair<std::string, std::string>>& ModuleCache::renames()
+{
+	return _renames;
+}
+
+void ModuleCache::fail()
+{
+	_failed = true;
+}
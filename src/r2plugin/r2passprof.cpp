@@ -0,0 +1,241 @@
+/**
+ * @file src/r2plugin/r2passprof.cpp
+ * @brief Time and memory profile of LLVM passes of a decompilation.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <fstream>
+#include <sstream>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2passprof.h"
+#include "r2plugin/r2trace.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+/**
+ * Pass inserted after passes of the pipeline by the profiler.
+ */
+class ProfilePass: public llvm::ModulePass {
+public:
+	static char ID;
+
+	ProfilePass(): ModulePass(ID) {}
+
+	bool runOnModule(llvm::Module& module) override
+	{
+		PassProfiler::sample(module.getInstructionCount());
+		return false;
+	}
+};
+
+char ProfilePass::ID = 0;
+
+llvm::RegisterPass<ProfilePass> profileRegistration(
+	"r2plugin-pass-profile",
+	"Records time and memory used by the preceding pass",
+	false,
+	false
+);
+
+}
+
+const std::string PassProfiler::ProfilePass = "r2plugin-pass-profile";
+
+std::vector<std::string> PassProfiler::_passes;
+std::vector<PassSample> PassProfiler::_samples;
+size_t PassProfiler::_next = 0;
+std::chrono::steady_clock::time_point PassProfiler::_last;
+uint64_t PassProfiler::_lastMemory = 0;
+uint64_t PassProfiler::_lastPeakMemory = 0;
+uint64_t PassProfiler::_lastInstructions = 0;
+
+/**
+ * Empty body for the destructor. The will forbid PassProfiler class
+ * to be instanciated.
+ */
+PassProfiler::~PassProfiler()
+{
+}
+
+bool PassProfiler::isEnabled()
+{
+	return Environment::isEnabled("DEC_PASS_PROFILE");
+}
+
+/**
+ * @brief Inserts profiling pass in front of the pipeline and after each
+ *        pass except checkpoints, and starts a new profile.
+ *
+ * Must be called after Governor::insertCheckpoints.
+ */
+void PassProfiler::instrument(config::Config& config)
+{
+	auto& passes = config.parameters.llvmPasses;
+
+	_passes.clear();
+	_samples.clear();
+	_next = 0;
+
+	std::vector<std::string> profiled;
+	profiled.reserve(passes.size()*2 + 1);
+	profiled.push_back(ProfilePass);
+
+	for (size_t i = 0; i < passes.size(); i++) {
+		auto& pass = passes[i];
+		profiled.push_back(pass);
+		if (pass == Governor::CheckpointPass)
+			continue;
+
+		// Checkpoint right after the pass is measured together with it.
+		if (i+1 < passes.size() && passes[i+1] == Governor::CheckpointPass)
+			profiled.push_back(passes[++i]);
+
+		_passes.push_back(pass);
+		profiled.push_back(ProfilePass);
+	}
+
+	passes = std::move(profiled);
+}
+
+/**
+ * @brief Takes sample after a pass. The first sample of a profile
+ *        only sets the baseline.
+ */
+void PassProfiler::sample(uint64_t instructions)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto memory = Governor::residentMemory();
+	auto peakMemory = peakResidentMemory();
+
+	if (_next > 0 && _next <= _passes.size()) {
+		std::chrono::duration<double, std::milli> elapsed = now - _last;
+		_samples.push_back({
+			_passes[_next-1],
+			elapsed.count(),
+			int64_t(memory) - int64_t(_lastMemory),
+			peakMemory > _lastPeakMemory ? peakMemory - _lastPeakMemory : 0,
+			_lastInstructions,
+			instructions
+		});
+
+		Trace::span(_passes[_next-1], "pass", _last, now, {
+			{"instructions before", std::to_string(_lastInstructions)},
+			{"instructions after", std::to_string(instructions)}
+		});
+	}
+
+	_next++;
+	_lastMemory = memory;
+	_lastPeakMemory = peakMemory;
+	_lastInstructions = instructions;
+
+	// Time of sampling itself is not accounted to the next pass.
+	_last = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Returns path of the profile stored with the cached result
+ *        of the config.
+ */
+fs::path PassProfiler::path(const config::Config& config)
+{
+	return fs::path(config.parameters.getOutputFile()).replace_filename("rd_passes.tsv");
+}
+
+/**
+ * @brief Saves profile of the last decompilation of the config
+ *        with the key.
+ */
+void PassProfiler::save(const fs::path& file, const std::string& key)
+{
+	std::error_code err;
+	fs::create_directories(file.parent_path(), err);
+
+	std::ofstream output(file, std::ios::trunc);
+	output << "# key\t" << key << std::endl;
+	output << "# pass\tms\tmemory delta\tpeak memory delta\tinstructions before\tinstructions after" << std::endl;
+	for (auto& sample: _samples) {
+		output << sample.pass << "\t" << sample.milliseconds << "\t"
+			<< sample.memory << "\t" << sample.peakMemory << "\t"
+			<< sample.instructionsBefore << "\t" << sample.instructionsAfter << "\n";
+	}
+}
+
+/**
+ * @brief Loads profile of the decompilation of the config with the key.
+ *        Profile of a different config (e.g. left by another profile
+ *        of the pipeline or an older build of the binary) is empty.
+ */
+std::vector<PassSample> PassProfiler::load(const fs::path& file, const std::string& key)
+{
+	std::vector<PassSample> samples;
+
+	std::ifstream input(file);
+	std::string line;
+	if (!std::getline(input, line) || line != "# key\t"+key)
+		return samples;
+
+	while (std::getline(input, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		PassSample sample;
+		if (std::getline(fields, sample.pass, '\t')
+				&& fields >> sample.milliseconds >> sample.memory >> sample.peakMemory
+					>> sample.instructionsBefore >> sample.instructionsAfter)
+			samples.push_back(sample);
+	}
+
+	return samples;
+}
+
+/**
+ * @brief Returns peak resident memory of the process in bytes.
+ */
+uint64_t PassProfiler::peakResidentMemory()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return counters.PeakWorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+			reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+		return 0;
+
+	return info.resident_size_max;
+#else
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		// VmHWM:	  123456 kB
+		if (line.rfind("VmHWM:", 0) == 0) {
+			std::istringstream value(line.substr(6));
+			uint64_t kilobytes = 0;
+			value >> kilobytes;
+			return kilobytes << 10;
+		}
+	}
+
+	return 0;
+#endif
+}
@@ -0,0 +1,206 @@
+/**
+ * @file src/r2plugin/r2profile.cpp
+ * @brief Decompilation pipeline profiles.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2cost.h"
+#include "r2plugin/r2data.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2profile.h"
+
+#include "profiles-config.h"
+
+using namespace retdec::r2plugin;
+
+const std::string Profile::DefaultName = "full";
+
+Profile::Profile(const std::string& name, const std::string& help, const std::string& params):
+	_name(name),
+	_help(help),
+	_params(params)
+{
+}
+
+const std::string& Profile::name() const
+{
+	return _name;
+}
+
+const std::string& Profile::help() const
+{
+	return _help;
+}
+
+/**
+ * @brief Checks whether the profile does not override any parameter
+ *        of the default config.
+ */
+bool Profile::isDefault() const
+{
+	rapidjson::Document params;
+	params.Parse(_params.c_str());
+
+	return params.IsObject() && params.ObjectEmpty();
+}
+
+/**
+ * @brief Returns name of the directory with cached results of the profile.
+ *
+ * Name contains hash of the overridden parameters, so that results of
+ * a profile that was redefined since are not used.
+ */
+std::string Profile::cacheName() const
+{
+	std::ostringstream name;
+	name << _name << "-" << std::hex << CodeCache::checksum(
+		reinterpret_cast<const uint8_t*>(_params.data()), _params.size());
+
+	return name.str();
+}
+
+/**
+ * @brief Overrides decompParams of the JSON config by parameters
+ *        of the profile.
+ *
+ * @throws DecompilationError when the profile overrides parameter
+ *         that is not present in the config.
+ */
+std::string Profile::apply(const std::string& configJson) const
+{
+	rapidjson::Document config;
+	config.Parse(configJson.c_str());
+
+	rapidjson::Document params;
+	params.Parse(_params.c_str());
+
+	auto& decompParams = config["decompParams"];
+	for (auto it = params.MemberBegin(); it != params.MemberEnd(); ++it) {
+		auto name = it->name.GetString();
+		if (!decompParams.HasMember(name))
+			throw DecompilationError("profile "+_name+": unknown parameter: "+name);
+
+		decompParams[name].CopyFrom(it->value, config.GetAllocator());
+	}
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	config.Accept(writer);
+
+	return buffer.GetString();
+}
+
+/**
+ * @brief Parses profiles from JSON in the format of BuiltinProfilesJSON.
+ *
+ * @throws DecompilationError on malformed input.
+ */
+std::vector<Profile> Profile::parse(const std::string& json, const std::string& source)
+{
+	rapidjson::Document d;
+	d.Parse(json.c_str());
+	if (d.HasParseError() || !d.IsObject() || !d.HasMember("profiles") || !d["profiles"].IsObject())
+		throw DecompilationError(source+": expected object with profiles");
+
+	std::vector<Profile> profiles;
+	const auto& entries = d["profiles"];
+	for (auto it = entries.MemberBegin(); it != entries.MemberEnd(); ++it) {
+		std::string name = it->name.GetString();
+		bool validName = !name.empty() && std::all_of(name.begin(), name.end(),
+			[](unsigned char c) {
+				return std::isalnum(c) || c == '-' || c == '_';
+			});
+
+		if (!validName)
+			throw DecompilationError(source+": invalid profile name: "+name);
+
+		const auto& entry = it->value;
+		if (!entry.IsObject() || !entry.HasMember("decompParams") || !entry["decompParams"].IsObject())
+			throw DecompilationError(source+": profile "+name+": expected decompParams object");
+
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		entry["decompParams"].Accept(writer);
+
+		std::string help = entry.HasMember("help") && entry["help"].IsString()
+			? entry["help"].GetString()
+			: "";
+
+		profiles.emplace_back(name, help, buffer.GetString());
+	}
+
+	return profiles;
+}
+
+/**
+ * @brief Returns built-in profiles followed by profiles from $DEC_PROFILES_FILE.
+ *
+ * User-defined profile replaces built-in profile of the same name.
+ */
+std::vector<Profile> Profile::available()
+{
+	auto profiles = parse(BuiltinProfilesJSON, "built-in profiles");
+
+	auto path = Environment::get("DEC_PROFILES_FILE");
+	if (path.empty())
+		return profiles;
+
+	std::ifstream file(path);
+	if (!file)
+		throw DecompilationError("invalid $DEC_PROFILES_FILE: cannot open "+path);
+
+	std::ostringstream content;
+	content << file.rdbuf();
+
+	for (auto& profile: parse(content.str(), path)) {
+		auto it = std::find_if(profiles.begin(), profiles.end(),
+			[&profile](const Profile& p) {
+				return p.name() == profile.name();
+			});
+
+		if (it != profiles.end())
+			*it = profile;
+		else
+			profiles.push_back(profile);
+	}
+
+	return profiles;
+}
+
+/**
+ * @throws DecompilationError when no profile of the name exists.
+ */
+Profile Profile::find(const std::string& name)
+{
+	for (auto& profile: available())
+		if (profile.name() == name)
+			return profile;
+
+	throw DecompilationError("unknown profile: "+name);
+}
+
+/**
+ * @brief Returns profile of the name or the profile selected
+ *        by $DEC_PROFILE when the name is empty.
+ *
+ * The auto profile is resolved by CostModel for single functions only.
+ * Other decompilations use the default profile instead.
+ */
+Profile Profile::selected(const std::string& name)
+{
+	auto selected = name.empty() ? Environment::get("DEC_PROFILE") : name;
+	if (selected == CostModel::ProfileName)
+		return find(DefaultName);
+
+	return find(selected);
+}
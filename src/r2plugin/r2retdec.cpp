@@ -1,9 +1,11 @@
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <functional>
 #include <fstream>
 #include <iterator>
 #include <mutex>
+#include <optional>
 
 #include <r_core.h>
 #include <retdec/retdec/retdec.h>
@@ -14,7 +16,20 @@
 #include <sstream>
 
 #include "r2plugin/r2retdec.h"
+#include "r2plugin/r2cache.h"
 #include "r2plugin/r2cgen.h"
+#include "r2plugin/r2cost.h"
+#include "r2plugin/r2dedup.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2governor.h"
+#include "r2plugin/r2image.h"
+#include "r2plugin/r2log.h"
+#include "r2plugin/r2metrics.h"
+#include "r2plugin/r2module.h"
+#include "r2plugin/r2passprof.h"
+#include "r2plugin/r2profile.h"
+#include "r2plugin/r2stats.h"
+#include "r2plugin/r2trace.h"
 #include "r2plugin/r2utils.h"
 
 #include "decompiler-config.h"
@@ -45,8 +60,7 @@ fs::path getOutDirPath(const fs::path &suffix)
 {
 	std::error_code err;
 
-	auto outDirRaw = getenv("DEC_SAVE_DIR");
-	std::string outDir(outDirRaw != nullptr ? outDirRaw : "");
+	std::string outDir = Environment::get("DEC_SAVE_DIR");
 	if (!outDir.empty()) {
 		auto outDirPath = fs::path(outDir);
 		if (!is_directory(outDirPath, err)) {
@@ -131,7 +145,10 @@ void constructHash(const retdec::config::Config& config, std::ostream& hash)
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 	d.Accept(writer);
 
-	hash << std::hex << std::hash<std::string>{}(buffer.GetString());
+	// Content of the input replaces its path removed with the parameters,
+	// so that patched bytes and rebuilt binaries are decompiled again.
+	hash << std::hex << std::hash<std::string>{}(buffer.GetString())
+		<< "-" << InputImage::checksum(config.parameters.getInputFile());
 }
 
 fs::path getHashPath(const fs::path& configPath)
@@ -139,33 +156,38 @@ fs::path getHashPath(const fs::path& configPath)
 	return fs::path(configPath).replace_filename(".rd_hash");
 }
 
+/**
+ * @brief Returns path of the compact binary cache of the decompilation output.
+ */
+fs::path getCachePath(const retdec::config::Config& config)
+{
+	return fs::path(config.parameters.getOutputFile()).replace_filename("rd_dec.bin");
+}
+
 /**
  * @brief Checks if cached files are up to date.
  */
-bool usableCacheExists(const retdec::config::Config& config)
+bool usableCacheExists(const retdec::config::Config& config, const std::string& hash)
 {
 	fs::path configPath(config.parameters.getOutputConfigFile());
 
 	if (!fs::is_regular_file(configPath))
 		return false;
 
-	std::ostringstream currHash;
-	constructHash(config, currHash);
-
 	std::string savedHash = loadHashString(getHashPath(configPath));
 
-	return currHash.str() == savedHash;
+	return hash == savedHash;
 }
 
 /**
  * @brief Creates file containng hash constructed from RD config.
  */
-void createConfigHashFile(const retdec::config::Config& config)
+void createConfigHashFile(const retdec::config::Config& config, const std::string& hash)
 {
 	fs::path configPath(config.parameters.getOutputConfigFile());
 	fs::path hashPath = getHashPath(configPath);
 	std::ofstream hashFile(hashPath);
-	constructHash(config, hashFile);
+	hashFile << hash;
 	hashFile.close();
 }
 
@@ -173,9 +195,9 @@ void createConfigHashFile(const retdec::config::Config& config)
  * @brief Tries to find and load default RetDec configuration file.
  *
  * Default configuration is installed with this plugin on default
- * location.
+ * location. Parameters of the configuration are overridden by the profile.
  */
-retdec::config::Config loadDefaultConfig()
+retdec::config::Config loadDefaultConfig(const Profile& profile)
 {
 	// Perhaps support signatures are installed in R2_HOME_PLUGDIR?
 #if R2_VERSION_NUMBER >= 50709
@@ -185,13 +207,26 @@ retdec::config::Config loadDefaultConfig()
 #endif
 
 	// Loads configuration from file - also contains default config.
-	auto rdConf = retdec::config::Config::fromJsonString(DefaultConfigJSON);
+	auto rdConf = retdec::config::Config::fromJsonString(profile.apply(DefaultConfigJSON));
 	// Paths to the signatures, etc.
 	rdConf.parameters.fixRelativePaths(plugdir);
 
 	return rdConf;
 }
 
+/**
+ * @brief Returns name of the directory in the output directory where
+ *        results of the binary are stored.
+ */
+fs::path getBinaryDirName(const std::string& binaryPath)
+{
+	// Create hex from bin name
+	std::ostringstream str;
+	str << std::hex << std::hash<std::string>{}(binaryPath);
+
+	return str.str();
+}
+
 std::string cacheName(const common::Function& fnc)
 {
 	std::ostringstream hexAddr;
@@ -199,82 +234,463 @@ std::string cacheName(const common::Function& fnc)
 	return fnc.getName()+"@"+hexAddr.str();
 }
 
-config::Config createConfig(const R2Database& binInfo, const std::string& cacheSuffix)
+/**
+ * @brief Checks whether RetDec's output is kept in memory.
+ *
+ * In-memory output is requested by createConfig by leaving output
+ * config file empty. Only the binary cache is then written to the disk.
+ */
+bool hasInMemoryOutput(const retdec::config::Config& config)
+{
+	return config.parameters.getOutputConfigFile().empty();
+}
+
+/**
+ * @brief Removes passes that dump intermediate results to files.
+ */
+void removeArtifactWriters(retdec::config::Config& config)
 {
-	auto config = loadDefaultConfig();
+	static const std::vector<std::string> writers = {
+		"retdec-write-dsm",
+		"retdec-write-ll",
+		"retdec-write-bc"
+	};
+
+	auto& passes = config.parameters.llvmPasses;
+	passes.erase(std::remove_if(passes.begin(), passes.end(),
+		[](const std::string& pass) {
+			return std::find(writers.begin(), writers.end(), pass) != writers.end();
+		}),
+		passes.end());
+}
 
-	// Fetch binary name -> will be used for caching
-	std::string binName = binInfo.fetchFilePath();
+config::Config createConfig(
+		const R2Database& binInfo,
+		const std::string& cacheSuffix,
+		const std::string& profileName)
+{
+	auto profile = Profile::selected(profileName);
+	auto config = loadDefaultConfig(profile);
 
-	// Create hex from bin name
-	std::ostringstream str;
-	str << std::hex << std::hash<std::string>{}(binName);
+	auto outputMode = Environment::get("DEC_OUTPUT");
+	if (outputMode != "disk" && outputMode != "memory")
+		throw DecompilationError("invalid $DEC_OUTPUT: "+outputMode);
+
+	bool inMemory = outputMode == "memory";
+
+	auto inputMode = Environment::get("DEC_INPUT");
+	if (inputMode != "file" && inputMode != "io" && inputMode != "slim")
+		throw DecompilationError("invalid $DEC_INPUT: "+inputMode);
+
+	auto binDir = getBinaryDirName(binInfo.fetchFilePath());
 
 	// Function is identified as : NAME@HEX_ADDR
-	auto outName = fs::path(str.str())/cacheSuffix;
+	auto outName = binDir/cacheSuffix;
+
+	// Results of each profile are cached separately so that switching
+	// between profiles does not invalidate the cache. Profiles that
+	// do not override the default config share its results.
+	if (!profile.isDefault())
+		outName /= profile.cacheName();
 
-	auto outDir = getOutDirPath(outName);
+	// In memory mode the directory is created only when cache is saved.
+	auto outDir = inMemory ? getOutDirPath()/outName : getOutDirPath(outName);
 
 	auto decpath = outDir/"rd_dec.json";
-	auto outpath = outDir/"rd_out.log";
-	auto errpath = outDir/"rd_err.log";
 	auto outconfig = outDir/"rd_config.json";
 
-	config.parameters.setInputFile(binInfo.fetchFilePath());
+	// Slim images are created per function by createFunctionConfig.
+	if (inputMode == "io")
+		config.parameters.setInputFile(
+			InputImage::fromIO(binInfo, getOutDirPath(binDir)).string());
+	else
+		config.parameters.setInputFile(binInfo.fetchFilePath());
+
 	config.parameters.setOutputFile(decpath.string());
-	config.parameters.setOutputConfigFile(outconfig.string());
+	config.parameters.setOutputConfigFile(inMemory ? "" : outconfig.string());
 	config.parameters.setOutputFormat("json-human");
-	config.parameters.setIsVerboseOutput(true);
-	config.parameters.setLogFile(outpath.string());
-	config.parameters.setErrFile(errpath.string());
+	// Logs are kept in memory by LogGuard during decompilation.
+	config.parameters.setIsVerboseOutput(LogGuard::isVerbose());
+	config.parameters.setLogFile("");
+	config.parameters.setErrFile("");
+
+	if (inMemory && !Environment::isEnabled("DEC_WRITE_IR"))
+		removeArtifactWriters(config);
 
 	return config;
 }
 
-std::pair<RCodeMeta*, retdec::config::Config> decompile(
+/**
+ * @brief Creates config for decompilation of a single function.
+ *
+ * With DEC_INPUT set to slim RetDec gets an image that contains only
+ * the function and memory it references instead of the whole binary.
+ *
+ * With the auto profile the profile and limits are selected by CostModel.
+ *
+ * @param budget When provided, it is set to the budget of the session
+ *               tightened by limits selected by CostModel, and the estimate
+ *               is kept until the decompilation is observed or forgotten.
+ */
+config::Config createFunctionConfig(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const std::string& profileName,
+		Budget* budget)
+{
+	Stats::Timer timer(Stats::Phase::Config);
+
+	auto profile = profileName.empty() ? Environment::get("DEC_PROFILE") : profileName;
+
+	std::optional<CostEstimate> cost;
+	R2FunctionMetrics metrics = {};
+	if (profile == CostModel::ProfileName) {
+		metrics = binInfo.fetchFunctionMetrics(fnc);
+		cost = CostModel::estimate(metrics);
+		profile = cost->profile;
+	}
+
+	auto config = createConfig(binInfo, cacheName(fnc), profile);
+	config.parameters.selectedRanges.insert(fnc);
+	config.parameters.setIsSelectedDecodeOnly(true);
+
+	if (budget != nullptr)
+		*budget = Budget::session();
+
+	// Estimate is observed only for decompilations, which request
+	// the budget.
+	if (cost && budget != nullptr) {
+		*budget = budget->tightened({cost->timeout*1000, cost->memoryLimit});
+		CostModel::expect(config.parameters.getOutputFile(), fnc.getName(), metrics, *cost);
+	}
+
+	// Slim image of in-memory output is written only while RetDec runs.
+	if (Environment::get("DEC_INPUT") == "slim") {
+		auto outDir = fs::path(config.parameters.getOutputFile()).parent_path();
+		config.parameters.setInputFile(
+			InputImage::slim(binInfo, fnc, outDir, hasInMemoryOutput(config)).string());
+	}
+
+	timer.stop();
+
+	Stats::Timer fetch(Stats::Phase::Fetch);
+	binInfo.fetchFunctionsAndGlobals(config);
+
+	return config;
+}
+
+/**
+ * Decompiles function(s) specified by the config within the budget.
+ *
+ * @throws BudgetExceeded when RetDec was stopped by the governor.
+ * @throws DecompilationError on other errors.
+ */
+std::pair<RCodeMeta*, retdec::config::Config> runDecompilation(
 		config::Config& config,
-		bool useCache)
+		bool useCache,
+		const Budget& budget,
+		CodeIndex* index)
 {
-	try {
-		if (useCache && usableCacheExists(config)) {
+	std::ostringstream hash;
+	{
+		Stats::Timer timer(Stats::Phase::Hash);
+		constructHash(config, hash);
+	}
+
+	bool inMemory = hasInMemoryOutput(config);
+
+	// Results cached without profile of passes are decompiled again
+	// with the whole pipeline when the profile is requested. Profile
+	// is not stored in memory output mode.
+	bool profilePasses = PassProfiler::isEnabled();
+	bool reuse = useCache && (!profilePasses || inMemory
+		|| !PassProfiler::load(PassProfiler::path(config), hash.str()).empty());
+
+	// Passes are measured for the trace too.
+	bool instrumentPasses = profilePasses || Trace::isEnabled();
+
+	if (reuse) {
+		Stats::Timer lookup(Stats::Phase::CacheLookup);
+		if (auto code = CodeCache::load(getCachePath(config), hash.str(), index))
+			return {code, config};
+
+		lookup.stop();
+
+		// Output of previous versions of the plugin contains only
+		// RetDec's JSON output. Convert it for subsequent runs.
+		if (usableCacheExists(config, hash.str())) {
 			R2CGenerator outgen;
-			return {outgen.generateOutput(config.parameters.getOutputFile()), config};
+			auto code = outgen.generateOutput(config.parameters.getOutputFile());
+			CodeIndex codeIndex(*code);
+			CodeCache::save(getCachePath(config), hash.str(), *code, codeIndex);
+			if (index != nullptr)
+				*index = std::move(codeIndex);
+
+			return {code, config};
+		}
+	}
+
+	// Memory is governed per decompilation. RetDec's own limit
+	// would be applied to the whole r2 process.
+	if (budget.memory != 0) {
+		config.parameters.setMaxMemoryLimit(0);
+		config.parameters.setIsMaxMemoryLimitHalfRam(false);
+	}
+
+	// When only names changed since the last decompilation the saved
+	// module is emitted again instead of running the whole pipeline.
+	// Functions analyzed by whole-binary decompilation are emitted
+	// from its module.
+	auto passes = config.parameters.llvmPasses;
+	auto structuralKey = ModuleCache::structuralKey(config);
+	auto sessionKey = ModuleCache::sessionKey(config);
+	bool saveModule = ModuleCache::isEnabled(config, useCache);
+	bool backendOnly = reuse && (ModuleCache::prepareBackendOnly(config, structuralKey)
+		|| ModuleCache::prepareFromWhole(config, structuralKey, sessionKey));
+	if (reuse)
+		Metrics::cacheLookup(Metrics::CacheTier::Module, backendOnly);
+	if (!backendOnly)
+		ModuleCache::prepareFull(config, saveModule);
+
+	Governor::insertCheckpoints(config);
+	if (instrumentPasses)
+		PassProfiler::instrument(config);
+	LogGuard::insertPass(config);
+
+	auto outDir = fs::path(config.parameters.getOutputFile()).parent_path();
+
+	std::string output;
+	{
+		// RetDec logs into buffers which are written to outDir only
+		// when decompilation fails.
+		LogGuard logs(outDir);
+		InputImage::Scope input(config.parameters.getInputFile());
+		Governor::Scope governor(budget);
+
+		auto start = std::chrono::steady_clock::now();
+
+		auto run = [&config, &output, &outDir, inMemory]() {
+			Stats::Timer timer(Stats::Phase::RetDec);
+
+			// Interface uses non-const config.
+			if (auto rc = retdec::decompile(config, inMemory ? &output : nullptr)) {
+				throw DecompilationError(
+					"decompilation ended with error code "
+					+ std::to_string(rc) +
+					", for more details check " + (outDir/"rd_err.log").string()
+				);
+			}
+		};
+
+		run();
+
+		if (backendOnly && ModuleCache::failed() && !Governor::isCancelled()) {
+			Log::error() << "cannot reuse saved module, running whole pipeline" << std::endl;
+
+			ModuleCache::invalidate(config);
+			config.parameters.llvmPasses = passes;
+			ModuleCache::prepareFull(config, saveModule);
+			Governor::insertCheckpoints(config);
+			if (instrumentPasses)
+				PassProfiler::instrument(config);
+			LogGuard::insertPass(config);
+			backendOnly = false;
+			output.clear();
+
+			run();
 		}
-		else {
-			createConfigHashFile(config);
+
+		if (Governor::isCancelled())
+			throw DecompilationCancelled();
+
+		auto exceeded = Governor::exceeded();
+		if (!exceeded.empty())
+			throw BudgetExceeded(exceeded);
+
+		// Backend-only, profiled and traced runs would distort calibration
+		// of the cost model.
+		if (!backendOnly) {
+			std::chrono::duration<double, std::milli> elapsed =
+				std::chrono::steady_clock::now() - start;
+			if (profilePasses && !inMemory)
+				PassProfiler::save(PassProfiler::path(config), hash.str());
+			if (!instrumentPasses)
+				CostModel::observe(config.parameters.getOutputFile(), elapsed.count());
+
+			ModuleCache::commit(config, structuralKey, sessionKey);
 		}
+	}
 
-		// Interface uses non-const config.
+	// Hash is written only after RetDec succeeded so that output
+	// of a stopped decompilation is never taken for a cached one.
+	if (!inMemory)
+		createConfigHashFile(config, hash.str());
 
-		if (auto rc = retdec::decompile(config)) {
-			// Note:
-			//   RetDec sets Loggers in decompile function based on settings in config.
-			//   After this function ends we want to print out on stdout/stderr again.
-			Log::set(Log::Type::Info, Logger::Ptr(new Logger(std::cout)));
-			Log::set(Log::Type::Error, Logger::Ptr(new Logger(std::cerr)));
+	R2CGenerator outgen;
+	auto code = inMemory
+		? outgen.generateOutputFromString(output)
+		: outgen.generateOutput(config.parameters.getOutputFile());
 
-			throw DecompilationError(
-				"decompilation ended with error code "
-				+ std::to_string(rc) +
-				"for more details check " + config.parameters.getErrFile()
-			);
+	CodeIndex codeIndex(*code);
+	if (useCache)
+		CodeCache::save(getCachePath(config), hash.str(), *code, codeIndex);
+
+	if (index != nullptr)
+		*index = std::move(codeIndex);
+
+	return {code, config};
+}
+
+/**
+ * Counts request that ended with the exception in metrics.
+ */
+void recordFailure(const std::exception& err)
+{
+	if (dynamic_cast<const DecompilationCancelled*>(&err) != nullptr)
+		Metrics::increment(Metrics::Counter::Cancellations);
+	else if (dynamic_cast<const BudgetExceeded*>(&err) != nullptr)
+		Metrics::increment(Metrics::Counter::Timeouts);
+	else
+		Metrics::increment(Metrics::Counter::Failures);
+}
+
+/**
+ * Decompiles function(s) specified by the config within the budget
+ * of the session.
+ *
+ * @param index When provided, it is filled with index of the returned code.
+ */
+std::pair<RCodeMeta*, retdec::config::Config> decompile(
+		config::Config& config,
+		bool useCache,
+		CodeIndex* index)
+{
+	Stats::Timer timer(Stats::Phase::Total);
+	Metrics::increment(Metrics::Counter::Requests);
+
+	try {
+		return runDecompilation(config, useCache, Budget::session(), index);
+	}
+	catch (const std::exception &err) {
+		recordFailure(err);
+		Log::error() << "decompilation error: " << err.what() << std::endl;
+	}
+	catch (...) {
+		Metrics::increment(Metrics::Counter::Failures);
+		Log::error() << "an unknown decompilation error occurred" << std::endl;
+	}
+
+	return {nullptr, retdec::config::Config::empty()};
+}
+
+/**
+ * Creates code that explains why the function was not decompiled.
+ */
+RCodeMeta* createPartialFailure(const common::Function& fnc, const std::vector<std::string>& reasons)
+{
+	std::ostringstream text;
+	text << "// Decompilation of " << fnc.getName() << " did not fit its budget:" << std::endl;
+	for (auto& reason: reasons)
+		text << "//   " << reason << std::endl;
+
+	text << "// Raise $DEC_TIME_BUDGET or $DEC_MEMORY_BUDGET to decompile it." << std::endl;
+
+	return r_codemeta_new(text.str().c_str());
+}
+
+/**
+ * Decompiles single function within its budget.
+ *
+ * When the budget is exceeded the decompilation is retried with the
+ * fallback profile. When that fails too, code that describes the failure
+ * is returned. It is not cached.
+ *
+ * @param index When provided, it is filled with index of the returned code.
+ * @param outOfBudget When provided, it is set when the returned code only
+ *                    describes the failure to fit the budget.
+ */
+std::pair<RCodeMeta*, retdec::config::Config> decompileFunction(
+		const R2Database& binInfo,
+		const common::Function& fnc,
+		const std::string& profileName,
+		CodeIndex* index,
+		bool* outOfBudget)
+{
+	if (outOfBudget != nullptr)
+		*outOfBudget = false;
+
+	Trace::Context trace(fnc.getName(), fnc.getStart());
+	Stats::Timer timer(Stats::Phase::Total);
+	Metrics::increment(Metrics::Counter::Requests);
+
+	try {
+		std::vector<std::string> reasons;
+
+		Budget budget;
+		auto config = createFunctionConfig(binInfo, fnc, profileName, &budget);
+		auto requestedPasses = config.parameters.llvmPasses;
+		CostModel::Expectation expectation(config.parameters.getOutputFile());
+
+		std::string dedupKey;
+		if (DedupStore::isEnabled()) {
+			dedupKey = DedupStore::key(binInfo, fnc, config);
+
+			auto start = Trace::Clock::now();
+			auto code = DedupStore::lookup(dedupKey, fnc, index);
+			Trace::span("dedup lookup", "cache", start, Trace::Clock::now(),
+				{{"hit", code != nullptr ? "true" : "false"}});
+			Metrics::cacheLookup(Metrics::CacheTier::Dedup, code != nullptr);
+
+			if (code != nullptr)
+				return {code, config};
+		}
+
+		try {
+			auto result = runDecompilation(config, true, budget, index);
+			Governor::record(Governor::Tier::Requested);
+			if (!dedupKey.empty() && result.first != nullptr)
+				DedupStore::store(binInfo, dedupKey, fnc, *result.first);
+
+			return result;
+		}
+		catch (const BudgetExceeded& err) {
+			Metrics::increment(Metrics::Counter::Timeouts);
+			reasons.push_back(err.what());
+		}
+
+		auto fallback = createFunctionConfig(binInfo, fnc, Governor::FallbackProfile, &budget);
+		if (fallback.parameters.llvmPasses != requestedPasses) {
+			Log::error() << "decompilation of " << fnc.getName() << ": " << reasons.back()
+				<< ", retrying with profile " << Governor::FallbackProfile << std::endl;
+
+			try {
+				auto result = runDecompilation(fallback, true, budget, index);
+				Governor::record(Governor::Tier::Degraded);
+				return result;
+			}
+			catch (const BudgetExceeded& err) {
+				Metrics::increment(Metrics::Counter::Timeouts);
+				reasons.push_back(Governor::FallbackProfile+": "+err.what());
+			}
 		}
 
-		// See note above.
-		Log::set(Log::Type::Info, Logger::Ptr(new Logger(std::cout)));
-		Log::set(Log::Type::Error, Logger::Ptr(new Logger(std::cerr)));
+		Governor::record(Governor::Tier::Failed);
+		Metrics::increment(Metrics::Counter::Failures);
 
-		R2CGenerator outgen;
-		return {outgen.generateOutput(config.parameters.getOutputFile()), config};
+		auto code = createPartialFailure(fnc, reasons);
+		if (index != nullptr)
+			*index = CodeIndex(*code);
+		if (outOfBudget != nullptr)
+			*outOfBudget = true;
+
+		return {code, config};
 	}
 	catch (const std::exception &err) {
-		Log::set(Log::Type::Info, Logger::Ptr(new Logger(std::cout)));
-		Log::set(Log::Type::Error, Logger::Ptr(new Logger(std::cerr)));
+		recordFailure(err);
 		Log::error() << "decompilation error: " << err.what() << std::endl;
 	}
 	catch (...) {
-		Log::set(Log::Type::Info, Logger::Ptr(new Logger(std::cout)));
-		Log::set(Log::Type::Error, Logger::Ptr(new Logger(std::cerr)));
+		Metrics::increment(Metrics::Counter::Failures);
 		Log::error() << "an unknown decompilation error occurred" << std::endl;
 	}
 
@@ -283,21 +699,18 @@ std::pair<RCodeMeta*, retdec::config::Config> decompile(
 
 /**
  * This function is to get RCodeMeta to pass it to Iaito's decompiler widget.
+ *
+ * New request supersedes the running one which is cancelled.
  */
 R_API RCodeMeta* decompile(RCore *core, ut64 addr){
 	static std::mutex mutex;
+
+	Governor::cancel();
 	std::lock_guard<std::mutex> lock (mutex);
 
 	R2Database binInfo(*core);
 
-	auto fnc = binInfo.fetchFunction(addr);
-	auto config = createConfig(binInfo, cacheName(fnc));
-	config.parameters.selectedRanges.insert(fnc);
-	config.parameters.setIsSelectedDecodeOnly(true);
-
-	binInfo.fetchFunctionsAndGlobals(config);
-
-	auto [code, _] = decompile(config, true);
+	auto [code, _] = decompileFunction(binInfo, binInfo.fetchFunction(addr));
 	return code;
 }
 
@@ -0,0 +1,490 @@
+/**
+ * @file src/r2plugin/r2signature.cpp
+ * @brief Detection of statically linked library code.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+#include <retdec/utils/io/log.h>
+
+#include "r2plugin/r2cache.h"
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2retdec.h"
+#include "r2plugin/r2signature.h"
+
+using namespace retdec::r2plugin;
+using retdec::utils::io::Log;
+
+namespace {
+
+/// ELF constants used by the object reader.
+const uint16_t ET_REL = 1;
+const uint16_t EM_ARM = 40;
+const uint32_t SHT_SYMTAB = 2;
+const uint32_t SHT_NOBITS = 8;
+const uint8_t STB_LOCAL = 0;
+const uint8_t STT_FUNC = 2;
+
+/**
+ * Bounds checked reader of ELF fields in the byte order of the object.
+ */
+class ElfReader {
+public:
+	ElfReader(const std::vector<uint8_t>& data, bool bigEndian):
+		_data(data), _bigEndian(bigEndian)
+	{
+	}
+
+	uint64_t read(uint64_t offset, size_t size) const
+	{
+		if (offset > _data.size() || size > _data.size() - offset)
+			throw retdec::r2plugin::DecompilationError("truncated ELF object");
+
+		uint64_t value = 0;
+		for (size_t i = 0; i < size; i++) {
+			auto byte = _data[offset + (_bigEndian ? i : size - i - 1)];
+			value = (value << 8) | byte;
+		}
+
+		return value;
+	}
+
+	std::string string(uint64_t offset) const
+	{
+		if (offset >= _data.size())
+			return "";
+
+		auto begin = _data.begin() + offset;
+		return std::string(begin, std::find(begin, _data.end(), 0));
+	}
+
+	std::vector<uint8_t> bytes(uint64_t offset, uint64_t size) const
+	{
+		if (offset > _data.size() || size > _data.size() - offset)
+			throw retdec::r2plugin::DecompilationError("truncated ELF object");
+
+		return std::vector<uint8_t>(_data.begin() + offset, _data.begin() + offset + size);
+	}
+
+private:
+	const std::vector<uint8_t>& _data;
+	bool _bigEndian;
+};
+
+std::string trim(const std::string& str)
+{
+	auto end = str.find_last_not_of(' ');
+	return end == std::string::npos ? "" : str.substr(0, end + 1);
+}
+
+/**
+ * Names r2's analysis gives to functions without a symbol (fcn.00401000
+ * is fetched as fcn_00401000). Other names come from symbols or user.
+ */
+bool isGeneratedName(const std::string& name)
+{
+	return name.size() > 4 && name.compare(0, 4, "fcn_") == 0
+		&& std::all_of(name.begin()+4, name.end(),
+			[](unsigned char c) {
+				return std::isxdigit(c);
+			});
+}
+
+/**
+ * Appends numeric suffix to the name when it is already taken.
+ */
+std::string uniqueName(const std::string& name, const std::set<std::string>& taken)
+{
+	if (!taken.count(name))
+		return name;
+
+	for (size_t i = 1;; i++) {
+		auto candidate = name+"_"+std::to_string(i);
+		if (!taken.count(candidate))
+			return candidate;
+	}
+}
+
+}
+
+const size_t SignatureIndex::MinimumSize = 16;
+
+fs::path SignatureIndex::_loadedPath;
+std::map<std::pair<std::string, uint64_t>, Signature> SignatureIndex::_signatures;
+
+/**
+ * Empty body for the destructor. The will forbid SignatureIndex class
+ * to be instanciated.
+ */
+SignatureIndex::~SignatureIndex()
+{
+}
+
+fs::path SignatureIndex::path()
+{
+	auto custom = Environment::get("DEC_SIGNATURES");
+	if (!custom.empty())
+		return custom;
+
+	return getOutDirPath()/"rd_signatures.idx";
+}
+
+std::string SignatureIndex::archName(const R2Architecture& arch)
+{
+	return arch.name+"/"+std::to_string(arch.bits);
+}
+
+/**
+ * @brief Loads the index unless it was already loaded in this session.
+ *
+ * Index file consists of lines:
+ *     <arch>\t<hash>\t<size>\t<name>\t<library>
+ */
+void SignatureIndex::load()
+{
+	auto indexPath = path();
+	if (indexPath == _loadedPath)
+		return;
+
+	_signatures.clear();
+	_loadedPath = indexPath;
+
+	std::ifstream index(indexPath);
+	std::string line;
+	while (std::getline(index, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		std::string arch, name, library;
+		uint64_t hash = 0;
+		size_t size = 0;
+		if (!std::getline(fields, arch, '\t')
+				|| !(fields >> std::hex >> hash >> std::dec >> size)
+				|| !std::getline(fields.ignore(), name, '\t')
+				|| !std::getline(fields, library))
+			continue;
+
+		_signatures.emplace(std::make_pair(arch, hash), Signature{name, library, size});
+	}
+}
+
+void SignatureIndex::save()
+{
+	std::error_code err;
+	fs::create_directories(_loadedPath.parent_path(), err);
+
+	std::ofstream index(_loadedPath, std::ios::trunc);
+	if (!index)
+		throw DecompilationError("unable to write signature index: "+_loadedPath.string());
+
+	index << "# retdec-r2plugin signatures: arch, hash, size, name, library" << std::endl;
+	for (auto& [key, signature]: _signatures) {
+		index << key.first << "\t" << std::hex << key.second << "\t"
+			<< std::dec << signature.size << "\t" << signature.name << "\t"
+			<< signature.library << "\n";
+	}
+}
+
+size_t SignatureIndex::size()
+{
+	load();
+	return _signatures.size();
+}
+
+/**
+ * @brief Reads members of a static archive in the common (GNU or BSD) format.
+ *
+ * @throws DecompilationError when the file is not an archive.
+ */
+std::vector<std::pair<std::string, std::vector<uint8_t>>> SignatureIndex::readArchive(
+		const fs::path& archive)
+{
+	std::ifstream file(archive, std::ios::binary);
+	if (!file)
+		throw DecompilationError("unable to open archive: "+archive.string());
+
+	std::vector<uint8_t> data(
+		(std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+
+	const std::string magic = "!<arch>\n";
+	if (data.size() < magic.size() || !std::equal(magic.begin(), magic.end(), data.begin()))
+		throw DecompilationError("not a static archive: "+archive.string());
+
+	// Member header: name[16] date[12] uid[6] gid[6] mode[8] size[10] fmag[2]
+	const size_t headerSize = 60;
+
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> members;
+	std::string longNames;
+
+	size_t pos = magic.size();
+	while (pos + headerSize <= data.size()) {
+		auto header = reinterpret_cast<const char*>(&data[pos]);
+		auto name = trim(std::string(header, 16));
+		auto size = std::strtoull(std::string(header+48, 10).c_str(), nullptr, 10);
+
+		pos += headerSize;
+		if (size > data.size() - pos)
+			throw DecompilationError("truncated archive: "+archive.string());
+
+		auto begin = data.begin() + pos;
+		auto end = begin + size;
+		pos += size + (size & 1);
+
+		if (name == "/" || name == "/SYM64/" || name.rfind("__.SYMDEF", 0) == 0)
+			continue;
+
+		if (name == "//") {
+			longNames.assign(begin, end);
+			continue;
+		}
+
+		if (name.size() > 1 && name[0] == '/' && std::isdigit(static_cast<unsigned char>(name[1]))) {
+			auto offset = std::strtoull(name.c_str()+1, nullptr, 10);
+			name = offset < longNames.size()
+				? longNames.substr(offset, longNames.find_first_of("/\n", offset) - offset)
+				: "";
+		}
+		else if (name.rfind("#1/", 0) == 0) {
+			// BSD stores long names in front of the member data.
+			size_t length = std::min<size_t>(std::strtoull(name.c_str()+3, nullptr, 10), size);
+			name.assign(begin, begin + length);
+			name = name.c_str();
+			begin += length;
+		}
+		else if (!name.empty() && name.back() == '/')
+			name.pop_back();
+
+		members.emplace_back(name, std::vector<uint8_t>(begin, end));
+	}
+
+	return members;
+}
+
+/**
+ * @brief Reads global functions defined in a relocatable ELF object.
+ *
+ * Objects for a different word size are skipped.
+ */
+std::vector<SignatureIndex::ObjectFunction> SignatureIndex::readObject(
+		const std::vector<uint8_t>& object,
+		const R2Architecture& arch)
+{
+	std::vector<ObjectFunction> result;
+	if (object.size() < 0x34 || std::memcmp(object.data(), "\x7f" "ELF", 4) != 0)
+		return result;
+
+	bool is64 = object[4] == 2;
+	if (is64 != (arch.bits == 64))
+		return result;
+
+	ElfReader elf(object, object[5] == 2);
+	if (elf.read(16, 2) != ET_REL)
+		return result;
+
+	auto machine = elf.read(18, 2);
+	auto shoff = is64 ? elf.read(0x28, 8) : elf.read(0x20, 4);
+	auto shentsize = is64 ? elf.read(0x3a, 2) : elf.read(0x2e, 2);
+	auto shnum = is64 ? elf.read(0x3c, 2) : elf.read(0x30, 2);
+
+	struct Section {
+		uint32_t type;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t link;
+	};
+
+	std::vector<Section> sections;
+	for (uint64_t i = 0; i < shnum; i++) {
+		auto sh = shoff + i*shentsize;
+		sections.push_back(is64
+			? Section{uint32_t(elf.read(sh+4, 4)), elf.read(sh+24, 8), elf.read(sh+32, 8), uint32_t(elf.read(sh+40, 4))}
+			: Section{uint32_t(elf.read(sh+4, 4)), elf.read(sh+16, 4), elf.read(sh+20, 4), uint32_t(elf.read(sh+24, 4))});
+	}
+
+	for (auto& symtab: sections) {
+		if (symtab.type != SHT_SYMTAB || symtab.link >= sections.size())
+			continue;
+
+		auto& strtab = sections[symtab.link];
+		size_t entsize = is64 ? 24 : 16;
+
+		for (uint64_t sym = symtab.offset; sym + entsize <= symtab.offset + symtab.size; sym += entsize) {
+			auto nameOffset = elf.read(sym, 4);
+			auto info = is64 ? elf.read(sym+4, 1) : elf.read(sym+12, 1);
+			auto shndx = is64 ? elf.read(sym+6, 2) : elf.read(sym+14, 2);
+			auto value = is64 ? elf.read(sym+8, 8) : elf.read(sym+4, 4);
+			auto size = is64 ? elf.read(sym+16, 8) : elf.read(sym+8, 4);
+
+			if ((info & 0xf) != STT_FUNC || (info >> 4) == STB_LOCAL)
+				continue;
+
+			if (shndx == 0 || shndx >= sections.size() || size < MinimumSize)
+				continue;
+
+			auto& section = sections[shndx];
+			if (section.type == SHT_NOBITS)
+				continue;
+
+			// Thumb functions have the lowest bit of their address set.
+			if (machine == EM_ARM)
+				value &= ~uint64_t(1);
+
+			if (value > section.size || size > section.size - value)
+				continue;
+
+			result.push_back({
+				elf.string(strtab.offset + nameOffset),
+				value,
+				elf.bytes(section.offset + value, size)
+			});
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Adds global functions of the archive to the index and saves it.
+ *
+ * Functions are normalized by r2's analysis of the current session,
+ * so the archive has to be built for the architecture of the analyzed
+ * binary.
+ *
+ * @returns Number of functions added to the index.
+ */
+size_t SignatureIndex::addArchive(const R2Database& binInfo, const fs::path& archive)
+{
+	load();
+
+	auto arch = binInfo.fetchArchitecture();
+	auto archKey = archName(arch);
+
+	size_t added = 0;
+	for (auto& [member, object]: readArchive(archive)) {
+		std::vector<ObjectFunction> functions;
+		try {
+			functions = readObject(object, arch);
+		}
+		catch (const DecompilationError&) {
+			continue;
+		}
+
+		for (auto& fnc: functions) {
+			auto bytes = fnc.bytes;
+			binInfo.normalizeBytes(bytes, fnc.offset);
+
+			auto hash = CodeCache::checksum(bytes.data(), bytes.size());
+			auto library = archive.filename().string()+"("+member+")";
+
+			// First function with the body wins, further ones are usually aliases.
+			if (_signatures.emplace(std::make_pair(archKey, hash), Signature{fnc.name, library, bytes.size()}).second)
+				added++;
+		}
+	}
+
+	save();
+
+	return added;
+}
+
+/**
+ * @brief Finds library function with the same normalized body.
+ *
+ * @returns nullptr when the function is not known to the index.
+ */
+const Signature* SignatureIndex::match(const R2Database& binInfo, const common::Function& fnc)
+{
+	load();
+
+	size_t size = fnc.getSize();
+	if (_signatures.empty() || size < MinimumSize)
+		return nullptr;
+
+	auto bytes = binInfo.fetchNormalizedBytes(fnc);
+	auto hash = CodeCache::checksum(bytes.data(), bytes.size());
+
+	auto it = _signatures.find({archName(binInfo.fetchArchitecture()), hash});
+	if (it == _signatures.end() || it->second.size != size)
+		return nullptr;
+
+	return &it->second;
+}
+
+/**
+ * @brief Matches all functions of the binary and renames matched ones in r2.
+ *
+ * Only functions with names generated by r2's analysis are renamed,
+ * names from symbols and names given by user are kept. Name that is
+ * already taken (e.g. by another copy of the same library function)
+ * gets a numeric suffix. Function that fails to be matched or renamed
+ * is skipped.
+ *
+ * @returns Matched functions by their address.
+ */
+std::map<R2Address, Signature> SignatureIndex::identify(const R2Database& binInfo)
+{
+	std::map<R2Address, Signature> matched;
+
+	auto functions = binInfo.fetchFunctions();
+
+	std::set<std::string> names;
+	for (auto& fnc: functions)
+		names.insert(fnc.getName());
+
+	for (auto& fnc: functions) {
+		try {
+			auto signature = match(binInfo, fnc);
+			if (signature == nullptr)
+				continue;
+
+			matched.emplace(fnc.getStart(), *signature);
+			if (fnc.getName() == signature->name || !isGeneratedName(fnc.getName()))
+				continue;
+
+			auto name = uniqueName(signature->name, names);
+			binInfo.renameFunction(fnc.getStart(), name);
+
+			names.erase(fnc.getName());
+			names.insert(name);
+		}
+		catch (const DecompilationError& err) {
+			Log::error() << Log::Warning << "library function " << fnc.getName()
+				<< ": " << err.what() << std::endl;
+		}
+	}
+
+	return matched;
+}
+
+/**
+ * @brief Marks matched functions in the config as statically linked.
+ *
+ * RetDec does not emit bodies of statically linked functions, only calls
+ * to them.
+ */
+void SignatureIndex::exclude(
+		config::Config& config,
+		const std::map<R2Address, Signature>& matched)
+{
+	if (matched.empty())
+		return;
+
+	common::FunctionContainer functions;
+	for (auto fnc: config.functions) {
+		if (matched.count(fnc.getStart()))
+			fnc.setIsStaticallyLinked();
+
+		functions.insert(fnc);
+	}
+
+	config.functions = std::move(functions);
+}
@@ -0,0 +1,160 @@
+/**
+ * @file src/r2plugin/r2stats.cpp
+ * @brief Latency of phases of decompilation requests.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "r2plugin/r2metrics.h"
+#include "r2plugin/r2stats.h"
+#include "r2plugin/r2trace.h"
+
+using namespace retdec::r2plugin;
+
+const size_t Stats::Window = 4096;
+
+std::mutex Stats::_mutex;
+std::array<std::deque<double>, size_t(Stats::Phase::Count)> Stats::_samples;
+std::array<uint64_t, size_t(Stats::Phase::Count)> Stats::_counts = {};
+std::array<double, size_t(Stats::Phase::Count)> Stats::_max = {};
+
+/**
+ * Empty body for the destructor. The will forbid Stats class
+ * to be instanciated.
+ */
+Stats::~Stats()
+{
+}
+
+Stats::Timer::Timer(Phase phase):
+	_phase(phase),
+	_start(std::chrono::steady_clock::now())
+{
+}
+
+Stats::Timer::~Timer()
+{
+	stop();
+}
+
+void Stats::Timer::stop()
+{
+	if (!_running)
+		return;
+
+	_running = false;
+	auto end = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> elapsed = end - _start;
+	record(_phase, elapsed.count());
+	Metrics::observe(_phase, elapsed.count());
+
+	Trace::span(phaseName(_phase), "phase", _start, end);
+}
+
+void Stats::record(Phase phase, double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto i = size_t(phase);
+	_samples[i].push_back(milliseconds);
+	if (_samples[i].size() > Window)
+		_samples[i].pop_front();
+
+	_counts[i]++;
+	_max[i] = std::max(_max[i], milliseconds);
+}
+
+/**
+ * @brief Returns aggregates of the phase. Percentiles use nearest rank.
+ */
+Stats::Summary Stats::summary(Phase phase)
+{
+	std::vector<double> samples;
+	Summary result = {};
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto i = size_t(phase);
+		samples.assign(_samples[i].begin(), _samples[i].end());
+		result.count = _counts[i];
+		result.max = _max[i];
+	}
+
+	if (samples.empty())
+		return result;
+
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		auto rank = size_t(std::ceil(p * samples.size()));
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+
+	result.p50 = percentile(0.50);
+	result.p95 = percentile(0.95);
+	result.p99 = percentile(0.99);
+
+	return result;
+}
+
+std::string Stats::phaseName(Phase phase)
+{
+	switch (phase) {
+	case Phase::Fetch:
+		return "r2 fetch";
+	case Phase::Config:
+		return "config";
+	case Phase::Hash:
+		return "hash";
+	case Phase::CacheLookup:
+		return "cache lookup";
+	case Phase::RetDec:
+		return "retdec";
+	case Phase::JsonParse:
+		return "json parse";
+	case Phase::Annotations:
+		return "annotations";
+	case Phase::Total:
+		return "total";
+	case Phase::Count:
+		break;
+	}
+
+	return "";
+}
+
+/**
+ * @brief Dumps aggregates of all phases as JSON object keyed by phase name.
+ */
+std::string Stats::toJson()
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	for (size_t i = 0; i < size_t(Phase::Count); i++) {
+		auto phase = Phase(i);
+		auto stats = summary(phase);
+
+		writer.Key(phaseName(phase).c_str());
+		writer.StartObject();
+		writer.Key("count");
+		writer.Uint64(stats.count);
+		writer.Key("p50");
+		writer.Double(stats.p50);
+		writer.Key("p95");
+		writer.Double(stats.p95);
+		writer.Key("p99");
+		writer.Double(stats.p99);
+		writer.Key("max");
+		writer.Double(stats.max);
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	return buffer.GetString();
+}
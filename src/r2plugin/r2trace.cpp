@@ -0,0 +1,198 @@
+/**
+ * @file src/r2plugin/r2trace.cpp
+ * @brief Export of decompilation sessions as Chrome trace events.
+ * @copyright (c) 2020 Avast Software, licensed under the MIT license.
+ */
+
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "r2plugin/r2env.h"
+#include "r2plugin/r2trace.h"
+
+using namespace retdec::r2plugin;
+
+namespace {
+
+int openForAppend(const std::string& path)
+{
+#if defined(_WIN32)
+	return _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+#endif
+}
+
+void closeFile(int fd)
+{
+#if defined(_WIN32)
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+bool isEmptyFile(int fd)
+{
+	struct stat info;
+	return fstat(fd, &info) == 0 && info.st_size == 0;
+}
+
+}
+
+std::mutex Trace::_mutex;
+int Trace::_fd = -1;
+std::string Trace::_path;
+
+thread_local std::string Trace::_function;
+thread_local R2Address Trace::_address = 0;
+thread_local bool Trace::_hasContext = false;
+
+/**
+ * Empty body for the destructor. The will forbid Trace class
+ * to be instanciated.
+ */
+Trace::~Trace()
+{
+}
+
+Trace::Context::Context(const std::string& function, R2Address address):
+	_previousFunction(_function),
+	_previousAddress(_address),
+	_previousSet(_hasContext)
+{
+	_function = function;
+	_address = address;
+	_hasContext = true;
+}
+
+Trace::Context::~Context()
+{
+	_function = _previousFunction;
+	_address = _previousAddress;
+	_hasContext = _previousSet;
+}
+
+bool Trace::isEnabled()
+{
+	return !Environment::get("DEC_TRACE_FILE").empty();
+}
+
+/**
+ * @brief Opens the trace file unless it is already open.
+ *
+ * Events are written in JSON array format. Trace viewers accept
+ * the array without its closing bracket, so the file is valid
+ * at any time and even after the process crashes.
+ */
+bool Trace::open(const std::string& path)
+{
+	if (path == _path && _fd >= 0)
+		return true;
+
+	if (_fd >= 0)
+		closeFile(_fd);
+
+	_path = path;
+
+	// Workers forked from the session append their events to the same file.
+	_fd = openForAppend(path);
+	if (_fd < 0)
+		return false;
+
+	if (isEmptyFile(_fd))
+		write("[\n");
+
+	return true;
+}
+
+/**
+ * @brief Appends data to the trace file by a single write.
+ */
+void Trace::write(const std::string& data)
+{
+	// Trace is best effort, the request goes on without it.
+#if defined(_WIN32)
+	(void)_write(_fd, data.data(), unsigned(data.size()));
+#else
+	(void)!::write(_fd, data.data(), data.size());
+#endif
+}
+
+/**
+ * @brief Writes span to the trace file when tracing is enabled.
+ */
+void Trace::span(
+		const std::string& name,
+		const std::string& category,
+		Clock::time_point start,
+		Clock::time_point end,
+		const std::map<std::string, std::string>& args)
+{
+	auto path = Environment::get("DEC_TRACE_FILE");
+	if (path.empty())
+		return;
+
+	using Micro = std::chrono::duration<double, std::micro>;
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("name");
+	writer.String(name.c_str());
+	writer.Key("cat");
+	writer.String(category.c_str());
+	writer.Key("ph");
+	writer.String("X");
+	// Monotonic clock is shared by all processes, so that spans
+	// of the session and its workers line up.
+	writer.Key("ts");
+	writer.Double(Micro(start.time_since_epoch()).count());
+	writer.Key("dur");
+	writer.Double(Micro(end - start).count());
+	writer.Key("pid");
+	writer.Int64(getpid());
+	writer.Key("tid");
+	writer.Uint64(std::hash<std::thread::id>{}(std::this_thread::get_id()) & 0xffffffff);
+
+	writer.Key("args");
+	writer.StartObject();
+	if (_hasContext) {
+		std::ostringstream address;
+		address << "0x" << std::hex << _address;
+
+		writer.Key("function");
+		writer.String(_function.c_str());
+		writer.Key("address");
+		writer.String(address.str().c_str());
+	}
+	for (auto& [key, value]: args) {
+		writer.Key(key.c_str());
+		writer.String(value.c_str());
+	}
+	writer.EndObject();
+	writer.EndObject();
+
+	std::string event = buffer.GetString();
+	event += ",\n";
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (open(path))
+		write(event);
+}
@@ -5,11 +5,13 @@
  */
 
 #include <mutex>
+#include <string>
 
 #include <retdec/utils/io/log.h>
 #include <r_core.h>
 
 #include "r2plugin/r2data.h"
+#include "r2plugin/r2governor.h"
 #include "r2plugin/console/decompiler.h"
 
 using namespace retdec::r2plugin;
@@ -30,10 +32,16 @@ static int r2retdec_cmd(void *user, const char* input)
 	static std::mutex mutex;
 	RCore& core = *(RCore*)user;
 	R2Database binInfo(core);
+	std::string command(input);
 
 	try {
+		// Cancellation must not wait for the decompilation it cancels.
+		if (command.compare(0, 4, "pdzc") == 0)
+			return DecompilerConsole::handleCommand(command, binInfo);
+
 		std::lock_guard<std::mutex> lock (mutex);
-		return DecompilerConsole::handleCommand(std::string(input), binInfo);
+		Governor::ConsoleBreak consoleBreak;
+		return DecompilerConsole::handleCommand(command, binInfo);
 	}
 	catch (const std::exception& e) {
 		Log::error() << Log::Error << e.what() << std::endl;